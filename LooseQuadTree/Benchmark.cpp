@@ -0,0 +1,266 @@
+// portable benchmark of QuadTree, it needs nothing but the standard library:
+//   g++ -O2 -std=c++14 -pthread Benchmark.cpp src/QuadTree.cpp src/ConcurrentQuadTree.cpp src/QuadTreeView.cpp -o Benchmark
+// usage: Benchmark [--depth d] [--leaf n] [--loose f] [--queries q] [--workload name] [n ...]
+// the default sizes are 10k, 100k and 1M elements, pass 10000000 for the largest run.
+// every result is a csv line on stdout, so two runs can be diffed or loaded by a script
+#include "src/QuadTree.h"
+#include "src/QuadTreeView.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace LQT;
+
+// bytes allocated and not freed yet, every allocation keeps its size in front of it
+static std::atomic<long long> liveBytes(0);
+static const std::size_t allocHeader = 16;
+
+void* operator new(std::size_t size) {
+	char* p = static_cast<char*>(std::malloc(size + allocHeader));
+	if (!p) throw std::bad_alloc();
+	std::memcpy(p, &size, sizeof(size));
+	liveBytes += static_cast<long long>(size);
+	return p + allocHeader;
+}
+
+void operator delete(void* ptr) noexcept {
+	if (!ptr) return;
+	// through an integer, so the compiler doesn't take it for an access before the object
+	void* p = reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(ptr) - allocHeader);
+	std::size_t size;
+	std::memcpy(&size, p, sizeof(size));
+	liveBytes -= static_cast<long long>(size);
+	std::free(p);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	operator delete(ptr);
+}
+
+enum Workload { UNIFORM, CLUSTERED, MIXED, MOVING, WORKLOAD_COUNT };
+const char* workloadNames[WORKLOAD_COUNT] = { "uniform", "clustered", "mixed", "moving" };
+
+struct Options {
+	int maxDepth = 0; // adaptive, a fixed depth is far too shallow or deep for some of the sizes
+	int maxElePerLeaf = 8;
+	float looseFactor = 0;
+	int queries = 100000;
+	int workload = -1; // all
+	std::vector<int> sizes;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double ElapsedNs(const Clock::time_point& begin) {
+	return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+}
+
+void Report(Workload w, int n, const char* op, long long ops, double ns, long long bytes, long long hits) {
+	std::printf("%s,%d,%s,%lld,%.1f,%.3f,%lld,%lld\n", workloadNames[w], n, op, ops,
+		ops > 0 ? ns / ops : 0.0, ns / 1e6, bytes, hits);
+	std::fflush(stdout);
+}
+
+// the world grows with n, so the density of every workload is the same at every size
+QTRect WorldOf(int n) {
+	const float side = std::sqrt(static_cast<float>(n)) * 8;
+	return { 0, 0, side, side };
+}
+
+QTRect ClampRect(const QTRect& world, float cx, float cy, float w, float h) {
+	cx = std::min(std::max(cx, world.l), world.r);
+	cy = std::min(std::max(cy, world.t), world.b);
+	return { cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2 };
+}
+
+void CreateElements(Workload w, int n, std::mt19937& rng, std::vector<QNodeEle>& eles) {
+	const QTRect world = WorldOf(n);
+	const float side = world.r - world.l;
+	std::uniform_real_distribution<float> pos(0, side);
+	std::uniform_real_distribution<float> size(0.5f, 4);
+	std::uniform_real_distribution<float> unit(0, 1);
+	// clusters of about 1000 elements, as crowds around points of interest
+	std::vector<QTPoint> centers(std::max(n / 1000, 1));
+	for (QTPoint& c : centers) c = { pos(rng), pos(rng) };
+	std::normal_distribution<float> spread(0, side / 256);
+	eles.resize(n);
+	for (int i = 0; i < n; ++i) {
+		float cx = pos(rng), cy = pos(rng), sw = size(rng), sh = size(rng);
+		if (w == CLUSTERED) {
+			const QTPoint& c = centers[rng() % centers.size()];
+			cx = c.x + spread(rng);
+			cy = c.y + spread(rng);
+		}
+		else if (w == MIXED) {
+			// mostly small ones, a few buildings and a very few zones
+			const float p = unit(rng);
+			if (p < 0.005f) { sw = unit(rng) * side / 4; sh = unit(rng) * side / 4; }
+			else if (p < 0.05f) { sw = unit(rng) * side / 32; sh = unit(rng) * side / 32; }
+		}
+		eles[i] = QNodeEle(ClampRect(world, cx, cy, sw, sh), reinterpret_cast<void*>(static_cast<std::intptr_t>(i)));
+	}
+}
+
+void CreateQueries(int n, int count, std::mt19937& rng, std::vector<QTRect>& rects, std::vector<QTPoint>& points) {
+	const QTRect world = WorldOf(n);
+	std::uniform_real_distribution<float> pos(world.l, world.r);
+	rects.resize(count);
+	points.resize(count);
+	for (int i = 0; i < count; ++i) {
+		// about the view of a unit, a few elements each
+		rects[i] = ClampRect(world, pos(rng), pos(rng), 16, 16);
+		points[i] = { pos(rng), pos(rng) };
+	}
+}
+
+template<typename S>
+void RunListQueries(Workload w, int n, const char* op, const QuadTree& qt, const std::vector<S>& shapes) {
+	long long hits = 0;
+	std::list<QNodeEle> retList;
+	const Clock::time_point begin = Clock::now();
+	for (const S& s : shapes) {
+		retList.clear();
+		qt.Query(s, retList);
+		hits += static_cast<long long>(retList.size());
+	}
+	Report(w, n, op, static_cast<long long>(shapes.size()), ElapsedNs(begin), 0, hits);
+}
+
+template<typename S>
+void RunVisitorQueries(Workload w, int n, const char* op, const QuadTree& qt, const std::vector<S>& shapes) {
+	long long hits = 0;
+	QueryScratch scratch;
+	const Clock::time_point begin = Clock::now();
+	for (const S& s : shapes)
+		qt.Query(s, [&hits](const QNodeEle&) { ++hits; return true; }, scratch);
+	Report(w, n, op, static_cast<long long>(shapes.size()), ElapsedNs(begin), 0, hits);
+}
+
+// save the tree, load it into another one and query the snapshot in place, bytes is the size of the snapshot
+void RunSnapshot(Workload w, int n, const QuadTree& qt, const std::vector<QTRect>& rects) {
+	std::stringstream out;
+	Clock::time_point begin = Clock::now();
+	qt.Save(out, [](void* const& p) { return static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(p)); });
+	const std::string bytes = out.str();
+	Report(w, n, "save", 1, ElapsedNs(begin), static_cast<long long>(bytes.size()), 0);
+	// as a mapped file would be, 8 bytes aligned
+	std::vector<unsigned long long> snapshot((bytes.size() + 7) / 8);
+	std::memcpy(snapshot.data(), bytes.data(), bytes.size());
+	QuadTree loaded(WorldOf(n));
+	begin = Clock::now();
+	loaded.Load(snapshot.data(), bytes.size(), [](unsigned long long id) { return reinterpret_cast<void*>(static_cast<std::uintptr_t>(id)); });
+	Report(w, n, "load", 1, ElapsedNs(begin), static_cast<long long>(bytes.size()), 0);
+	QuadTreeView view;
+	begin = Clock::now();
+	view.Open(snapshot.data(), bytes.size());
+	Report(w, n, "view_open", 1, ElapsedNs(begin), static_cast<long long>(bytes.size()), 0);
+	long long hits = 0;
+	QueryScratch scratch;
+	begin = Clock::now();
+	for (const QTRect& r : rects)
+		view.Query(r, [&hits](const QTRect&, unsigned long long) { ++hits; return true; }, scratch);
+	Report(w, n, "query_rect_view", static_cast<long long>(rects.size()), ElapsedNs(begin), 0, hits);
+}
+
+void RunWorkload(Workload w, int n, const Options& opt) {
+	std::mt19937 rng(static_cast<unsigned int>(n * WORKLOAD_COUNT + w));
+	std::vector<QNodeEle> eles;
+	CreateElements(w, n, rng, eles);
+	std::vector<QTRect> rects;
+	std::vector<QTPoint> points;
+	CreateQueries(n, opt.queries, rng, rects, points);
+	std::vector<QNodeEleHandle> handles(n);
+	// bytes is the memory held by the tree after the step
+	const long long baseBytes = liveBytes;
+	QuadTree qt(WorldOf(n), opt.maxDepth, opt.maxElePerLeaf, opt.looseFactor);
+	Clock::time_point begin = Clock::now();
+	for (int i = 0; i < n; ++i)
+		handles[i] = qt.Insert(eles[i]);
+	Report(w, n, "insert", n, ElapsedNs(begin), liveBytes - baseBytes, 0);
+	RunListQueries(w, n, "query_rect_list", qt, rects);
+	RunVisitorQueries(w, n, "query_rect_visitor", qt, rects);
+	RunListQueries(w, n, "query_point_list", qt, points);
+	RunVisitorQueries(w, n, "query_point_visitor", qt, points);
+	RunSnapshot(w, n, qt, rects);
+	if (w == MOVING) {
+		// a tenth of the entities walk a step every frame, the dirty part is cleaned up a little every frame
+		const QTRect world = WorldOf(n);
+		std::uniform_real_distribution<float> step(-1, 1);
+		const int frames = 20, movers = std::max(n / 10, 1);
+		double moveNs = 0, cleanupNs = 0;
+		for (int f = 0; f < frames; ++f) {
+			std::vector<int> who(movers);
+			for (int& i : who) i = static_cast<int>(rng() % n);
+			for (int i : who) {
+				QTRect& r = eles[i].rect;
+				const QTPoint c = GetRectCenter(r);
+				r = ClampRect(world, c.x + step(rng), c.y + step(rng), r.r - r.l, r.b - r.t);
+			}
+			begin = Clock::now();
+			for (int i : who) qt.Move(handles[i], eles[i].rect);
+			moveNs += ElapsedNs(begin);
+			begin = Clock::now();
+			qt.Cleanup(1024);
+			cleanupNs += ElapsedNs(begin);
+		}
+		Report(w, n, "move", static_cast<long long>(frames) * movers, moveNs, liveBytes - baseBytes, 0);
+		Report(w, n, "cleanup_budget", frames, cleanupNs, liveBytes - baseBytes, 0);
+		RunVisitorQueries(w, n, "query_rect_visitor_moved", qt, rects);
+	}
+	// erase every other element, then clean up what they left
+	begin = Clock::now();
+	for (int i = 0; i < n; i += 2) qt.Erase(handles[i]);
+	Report(w, n, "erase", (n + 1) / 2, ElapsedNs(begin), liveBytes - baseBytes, 0);
+	begin = Clock::now();
+	qt.Cleanup();
+	Report(w, n, "cleanup", 1, ElapsedNs(begin), liveBytes - baseBytes, 0);
+	RunVisitorQueries(w, n, "query_rect_visitor_erased", qt, rects);
+	begin = Clock::now();
+	qt.Compact();
+	Report(w, n, "compact", 1, ElapsedNs(begin), liveBytes - baseBytes, 0);
+	RunVisitorQueries(w, n, "query_rect_visitor_compact", qt, rects);
+}
+
+bool ParseOptions(int argc, char** argv, Options& opt) {
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (arg == "--depth" && hasValue) opt.maxDepth = std::atoi(argv[++i]);
+		else if (arg == "--leaf" && hasValue) opt.maxElePerLeaf = std::atoi(argv[++i]);
+		else if (arg == "--loose" && hasValue) opt.looseFactor = static_cast<float>(std::atof(argv[++i]));
+		else if (arg == "--queries" && hasValue) opt.queries = std::atoi(argv[++i]);
+		else if (arg == "--workload" && hasValue) {
+			const std::string name = argv[++i];
+			for (int w = 0; w < WORKLOAD_COUNT; ++w)
+				if (name == workloadNames[w]) opt.workload = w;
+			if (opt.workload == -1) return false;
+		}
+		else if (std::atoi(arg.c_str()) > 0) opt.sizes.push_back(std::atoi(arg.c_str()));
+		else return false;
+	}
+	if (opt.sizes.empty()) opt.sizes = { 10000, 100000, 1000000 };
+	return true;
+}
+
+int main(int argc, char** argv) {
+	Options opt;
+	if (!ParseOptions(argc, argv, opt)) {
+		std::fprintf(stderr, "usage: %s [--depth d] [--leaf n] [--loose f] [--queries q] "
+			"[--workload uniform|clustered|mixed|moving] [n ...]\n", argv[0]);
+		return 1;
+	}
+	std::printf("workload,n,op,ops,ns_per_op,total_ms,bytes,hits\n");
+	for (int n : opt.sizes)
+		for (int w = 0; w < WORKLOAD_COUNT; ++w)
+			if (opt.workload == -1 || opt.workload == w) RunWorkload(static_cast<Workload>(w), n, opt);
+	return 0;
+}
@@ -42,33 +42,31 @@ class Container : public Listener{
 public:
 	Container(const QTRect& rect) : qt({ rect }) {}
 	void Dispatch(void* e) {
-		Element* ele = reinterpret_cast<Element*>(e);
-		updates.insert(std::make_pair(ele, ele->GetRect()));
+		updates.push_back(reinterpret_cast<Element*>(e));
 	}
 	void Add(Element* e) {
-		QNodeEle node(e->GetRect(), e);
-		qt.Insert(node);
+		handles[e] = qt.Insert({ e->GetRect(), e });
 		e->SetContainer(this);
 	}
 	std::vector<Element*> Query(const QTPoint& point) {
 		// update all elements
 		for (auto& iter : updates) {
-			qt.Erase({ iter.second, (void*)iter.first });
-			qt.Insert({ iter.first->GetRect(), (void*)iter.first });
-			iter.first->Clear();
+			qt.Move(handles[iter], iter->GetRect());
+			iter->Clear();
 		}
 		updates.clear();
 		// query quadtree
-		std::list<QNodeEle> relist;
-		qt.Query(point, relist);
 		std::vector<Element*> reVec;
-		for (auto& iter : relist)
-			reVec.push_back(reinterpret_cast<Element*>(iter.vPtr));
+		qt.Query(point, [&reVec](const QTElement<Element*>& ele) {
+			reVec.push_back(ele.payload);
+			return true;
+		});
 		return reVec;
 	}
 private:
-	QuadTree qt;
-	std::map<Element*, const QTRect> updates;
+	BasicQuadTree<Element*> qt;
+	std::map<Element*, QNodeEleHandle> handles;
+	std::vector<Element*> updates;
 };
 
 class EleA : public Element {
@@ -1,8 +1,18 @@
 #include "src/QuadTree.h"
+#include "src/ThreadPool.h"
+#include "src/ConcurrentQuadTree.h"
+#include "src/QuadTreeView.h"
 #include <vector>
 #include <list>
 #include <random>
 #include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <thread>
 #include <Windows.h>
 
 QTRect CreateRandomRect(const QTRect& range) {
@@ -24,6 +34,7 @@ const float proOfCleanup = 0.1f;
 
 std::vector<QNodeEle> randEle = std::vector<QNodeEle>(numOfEle);
 std::vector<int> eraseReg = std::vector<int>(numOfEle);
+std::vector<QNodeEleHandle> handleReg = std::vector<QNodeEleHandle>(numOfEle);
 std::vector<bool> eleExistReg = std::vector<bool>(numOfEle);
 std::vector<bool> cleanupReg = std::vector<bool>(numOfEle);
 std::random_device rdev;
@@ -49,15 +60,30 @@ void CreateTestData() {
 	}
 }
 
-void StartTest() {
-	QuadTree qt = QuadTree(qtRect);
-	for (unsigned int i = 0; i < numOfEle; ++i) {
-		if (eraseReg[i] != -1) qt.Erase(randEle[eraseReg[i]]);
-		if (cleanupReg[i]) qt.Cleanup();
-		qt.Insert(randEle[i]);
+// counts the bytes allocated through it and not freed yet
+std::atomic<std::size_t> countedBytes(0);
+template<typename T>
+struct CountingAllocator {
+	typedef T value_type;
+	CountingAllocator() = default;
+	template<typename U>
+	CountingAllocator(const CountingAllocator<U>&) {}
+	T* allocate(std::size_t n) {
+		countedBytes += n * sizeof(T);
+		return std::allocator<T>().allocate(n);
 	}
-	qt.Cleanup();
-	std::cout << "check~" << std::endl;
+	void deallocate(T* p, std::size_t n) {
+		countedBytes -= n * sizeof(T);
+		std::allocator<T>().deallocate(p, n);
+	}
+	template<typename U>
+	bool operator==(const CountingAllocator<U>&) const { return true; }
+	template<typename U>
+	bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+template<typename Tree>
+void CheckTree(const Tree& qt) {
 	for (unsigned int i = 0; i < numOfEle; ++i) {
 		QNodeEle& node = randEle[i];
 		QTPoint p = GetRectCenter(node.rect);
@@ -77,6 +103,783 @@ void StartTest() {
 	}
 }
 
+// whether a query at the center of ele finds it
+bool HasEle(const QuadTree& qt, const QNodeEle& ele) {
+	bool cp = false;
+	qt.Query(GetRectCenter(ele.rect), [&](const QNodeEle& e) { cp = e == ele; return !cp; });
+	return cp;
+}
+
+// index of an element, its payload
+std::size_t EleIndex(const QNodeEle& ele) {
+	return reinterpret_cast<std::uintptr_t>(ele.vPtr);
+}
+
+// every two intersecting elements of eles must be reported once, in either order
+void CheckPairs(const QuadTree& qt, const std::vector<QNodeEle>& eles) {
+	const std::size_t n = numOfEle + 2;
+	std::vector<int> seen(n * n);
+	int reported = 0, expected = 0;
+	qt.ForEachIntersectingPair([&](const QNodeEle& a, const QNodeEle& b) {
+		++seen[std::min(EleIndex(a), EleIndex(b)) * n + std::max(EleIndex(a), EleIndex(b))];
+		++reported;
+		return true;
+	});
+	for (std::size_t a = 0; a < eles.size(); ++a) {
+		for (std::size_t b = a; b < eles.size(); ++b) {
+			const int pair = a != b && IsRectsIntersect(eles[a].rect, eles[b].rect);
+			const std::size_t i = std::min(EleIndex(eles[a]), EleIndex(eles[b])), j = std::max(EleIndex(eles[a]), EleIndex(eles[b]));
+			expected += pair;
+			if (seen[i * n + j] != pair) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+		}
+	}
+	if (reported != expected) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+}
+
+// every two intersecting elements of lhsEles and rhsEles must be reported once, the one of lhs first
+void CheckJoin(const QuadTree& lhs, const QuadTree& rhs, const std::vector<QNodeEle>& lhsEles, const std::vector<QNodeEle>& rhsEles) {
+	const std::size_t n = numOfEle + 2;
+	std::vector<int> seen(n * n);
+	int reported = 0, expected = 0;
+	QuadTree::Join(lhs, rhs, [&](const QNodeEle& a, const QNodeEle& b) {
+		++seen[EleIndex(a) * n + EleIndex(b)];
+		++reported;
+		return true;
+	});
+	for (auto& a : lhsEles) {
+		for (auto& b : rhsEles) {
+			const int pair = IsRectsIntersect(a.rect, b.rect);
+			expected += pair;
+			if (seen[EleIndex(a) * n + EleIndex(b)] != pair) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+		}
+	}
+	if (reported != expected) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+}
+
+// the nearest elements to the center of every element, within maxDist, must be in the order of brute force
+void CheckNearest(const QuadTree& qt, const std::vector<QNodeEle>& eles, float maxDist) {
+	std::vector<std::pair<float, QNodeEle>> out;
+	std::vector<float> dists;
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		const QTPoint p = GetRectCenter(randEle[i].rect);
+		dists.clear();
+		for (auto& e : eles) {
+			const float d = GetRectPointDistanceSq(e.rect, p);
+			if (d <= maxDist * maxDist) dists.push_back(std::sqrt(d));
+		}
+		std::sort(dists.begin(), dists.end());
+		for (int k = 1; k <= 8; k += 7) {
+			const int n = qt.QueryNearest(p, k, maxDist, out);
+			if (n != std::min(k, static_cast<int>(dists.size())) || n != static_cast<int>(out.size())) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+			for (int j = 0; j < n; ++j) {
+				if (out[j].first != dists[j] || out[j].first != std::sqrt(GetRectPointDistanceSq(out[j].second.rect, p)) ||
+					!HasEle(qt, out[j].second)) {
+					std::cout << "wrong!" << std::endl;
+					throw("error");
+				}
+			}
+		}
+		QNodeEle nearest;
+		float dist;
+		const bool found = qt.QueryNearest(p, maxDist, nearest, &dist);
+		if (found != !dists.empty() || (found && dist != dists[0]) || qt.QueryNearest(p, -maxDist, nearest) ||
+			qt.QueryNearest(p, 8, -maxDist, out) != 0) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+}
+
+// segments between the centers of the elements must hit the elements of brute force, front to back
+void CheckRaycast(const QuadTree& qt, const std::vector<QNodeEle>& eles) {
+	std::vector<float> ts;
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		const QTPoint a = GetRectCenter(randEle[i].rect), b = GetRectCenter(randEle[(i * 7 + 1) % numOfEle].rect);
+		const QTPoint dir(b.x - a.x, b.y - a.y);
+		ts.clear();
+		float t;
+		for (auto& e : eles)
+			if (GetRayRectEntry(a, dir, 1.0f, e.rect, t)) ts.push_back(t);
+		std::sort(ts.begin(), ts.end());
+		unsigned int n = 0;
+		bool inOrder = true;
+		qt.Raycast(a, dir, 1.0f, [&](const QNodeEle& e, float et) {
+			inOrder = inOrder && n < ts.size() && et == ts[n] && GetRayRectEntry(a, dir, 1.0f, e.rect, t) && t == et && HasEle(qt, e);
+			++n;
+			return true;
+		});
+		// stopping at once gives the first hit
+		float first = -1;
+		qt.Raycast(a, dir, 1.0f, [&](const QNodeEle&, float et) { first = et; return false; });
+		if (!inOrder || n != ts.size() || (!ts.empty() && first != ts[0])) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+}
+
+// the shape query must hit every element of eles which intersect it once, and nothing else
+template<typename S>
+void CheckShape(const QuadTree& qt, const std::vector<QNodeEle>& eles, const S& shape) {
+	std::vector<int> seen(numOfEle + 2);
+	qt.Query(shape, [&](const QNodeEle& e) { ++seen[EleIndex(e)]; return true; });
+	int hits = 0;
+	for (auto& e : eles) {
+		const int hit = IsShapeIntersectRect(shape, e.rect);
+		hits += hit;
+		if (seen[EleIndex(e)] != hit) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	if (std::count(seen.begin(), seen.end(), 1) != hits) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+}
+
+// the box as a polygon whose edges are moved outward by grow
+QTConvexPolygon OBBToPolygon(const QTOBB& box, float grow) {
+	const float hx = box.halfSize.x + grow, hy = box.halfSize.y + grow;
+	QTPoint corners[4];
+	for (int i = 0; i < 4; ++i) {
+		const float x = i == 1 || i == 2 ? hx : -hx, y = i >= 2 ? hy : -hy;
+		corners[i] = QTPoint(box.center.x + x * box.axis.x - y * box.axis.y, box.center.y + x * box.axis.y + y * box.axis.x);
+	}
+	return QTConvexPolygon(corners, corners + 4);
+}
+
+// circles, boxes and polygons around the center of every element
+void CheckShapes(const QuadTree& qt, const std::vector<QNodeEle>& eles) {
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		const QTRect& rect = randEle[i].rect;
+		const QTPoint c = GetRectCenter(rect);
+		const QTCircle circle(c, static_cast<float>(rdev() % 200) / 10);
+		const QTOBB box(c, QTPoint(static_cast<float>(rdev() % 150) / 10 + 0.5f, static_cast<float>(rdev() % 80) / 10 + 0.5f),
+			static_cast<float>(rdev() % 628) / 100);
+		// a polygon in the other winding too
+		const QTPoint corners[4] = { { rect.l, rect.t }, { rect.r, rect.t }, { rect.r, rect.b }, { rect.l, rect.b } };
+		const QTPoint reversed[4] = { corners[3], corners[2], corners[1], corners[0] };
+		const QTConvexPolygon aligned(corners, corners + 4), alignedReversed(reversed, reversed + 4);
+		const QTConvexPolygon inner = OBBToPolygon(box, -1e-3f), outer = OBBToPolygon(box, 1e-3f);
+		CheckShape(qt, eles, circle);
+		CheckShape(qt, eles, box);
+		CheckShape(qt, eles, outer);
+		CheckShape(qt, eles, aligned);
+		QTRect4 four;
+		for (int j = 0; j < 4; ++j)
+			four.Set(j, eles[(i + j) % eles.size()].rect);
+		const int mask = GetShapeIntersectMask(circle, four);
+		for (int j = 0; j < 4; ++j) {
+			const QTRect& e = four.Get(j);
+			// the polygon of the box agrees with the box, up to the rounding of its corners,
+			// and an axis aligned polygon is a rect
+			if (((mask >> j) & 1) != IsShapeIntersectRect(circle, e) ||
+				(IsShapeIntersectRect(inner, e) && !IsShapeIntersectRect(box, e)) ||
+				(IsShapeIntersectRect(box, e) && !IsShapeIntersectRect(outer, e)) ||
+				IsShapeIntersectRect(aligned, e) != IsRectsIntersect(rect, e) ||
+				IsShapeIntersectRect(alignedReversed, e) != IsRectsIntersect(rect, e)) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+		}
+	}
+}
+
+// a tree of another Payload and Coord holds eles with their index as payload: each one is found at its center,
+// moved by its handle and erased by value. int coordinates round the rects outwards
+template<typename Tree>
+void CheckTypedTree(Tree& t, const std::vector<QNodeEle>& eles) {
+	typedef typename Tree::Element Element;
+	typedef decltype(Element().rect.l) Coord;
+	std::vector<Element> typed;
+	std::vector<QNodeEleHandle> handles;
+	for (std::size_t i = 0; i < eles.size(); ++i) {
+		const QTRect& e = eles[i].rect;
+		typed.push_back(Element({ static_cast<Coord>(std::floor(e.l)), static_cast<Coord>(std::floor(e.t)),
+			static_cast<Coord>(std::ceil(e.r)), static_cast<Coord>(std::ceil(e.b)) }, static_cast<int>(i)));
+		handles.push_back(t.Insert(typed[i]));
+	}
+	auto has = [&t](const Element& ele) {
+		bool cp = false;
+		t.Query(GetRectCenter(ele.rect), [&](const Element& e) { cp = e == ele; return !cp; });
+		return cp;
+	};
+	for (std::size_t i = 0; i < typed.size(); ++i) {
+		const Element moved({ typed[i].rect.l + 1, typed[i].rect.t + 1, typed[i].rect.r + 1, typed[i].rect.b + 1 }, typed[i].payload);
+		if (!has(typed[i]) || !t.Move(handles[i], moved.rect) || !has(moved) || has(typed[i]) ||
+			!t.Move(handles[i], typed[i].rect)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	for (auto& e : typed) {
+		if (!t.Erase(e)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	if (t.GetStats().elementCount != 0) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+}
+
+// write a snapshot of qt to data, which is 8 bytes aligned. return its size
+template<typename Tree>
+std::size_t SaveTree(const Tree& qt, std::vector<unsigned long long>& data) {
+	std::stringstream snapshot;
+	qt.Save(snapshot, [](void* const& p) { return static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(p)); });
+	const std::string bytes = snapshot.str();
+	data.assign((bytes.size() + 7) / 8, 0);
+	std::memcpy(data.data(), bytes.data(), bytes.size());
+	return bytes.size();
+}
+
+template<typename Tree>
+bool LoadTree(Tree& qt, const std::vector<unsigned long long>& data, std::size_t size) {
+	return qt.Load(data.data(), size, [](unsigned long long id) { return reinterpret_cast<void*>(static_cast<std::uintptr_t>(id)); });
+}
+
+// nodes section of a snapshot
+QTSnapshotNodeT<float>* SnapshotNodes(std::vector<unsigned long long>& data) {
+	return reinterpret_cast<QTSnapshotNodeT<float>*>(reinterpret_cast<char*>(data.data()) +
+		reinterpret_cast<const QTSnapshotHeader*>(data.data())->nodes);
+}
+
+// readers keep querying ct while the writer inserts, erases and moves, and publishes after every step.
+// a marker moved on every step tells which step a reader sees, and the rest of the copy must be that step:
+// step g inserted the elements [g * 4, g * 4 + 4) and erased the ones of step g - 2
+void CheckPublishedSteps(ConcurrentQuadTree& ct) {
+	const int steps = 100, perStep = 4;
+	void* const marker = (void*)-1;
+	auto rectOf = [](std::uintptr_t id) {
+		const float x = qtRect.l + (id * 7) % 89, y = qtRect.t + (id * 13) % 89;
+		return QTRect(x, y, x + 1, y + 1);
+	};
+	QNodeEleHandle markerHandle = ct.Insert(QNodeEle(QTRect(qtRect.l, qtRect.t, qtRect.l + 1, qtRect.t + 1), marker));
+	ct.Publish();
+	std::atomic<bool> done(false), failed(false);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 2; ++r) {
+		readers.emplace_back([&]() {
+			std::vector<int> seen;
+			while (!done) {
+				ct.Read([&](const QuadTree& t) {
+					int g = -1, count = 0;
+					seen.assign(steps * perStep, 0);
+					t.Query(qtRect, [&](const QNodeEle& e) {
+						++count;
+						if (e.vPtr == marker) g = static_cast<int>((e.rect.l - qtRect.l) * 2) - 1;
+						else {
+							const std::uintptr_t id = reinterpret_cast<std::uintptr_t>(e.vPtr);
+							if (id >= seen.size() || !(e.rect == rectOf(id))) failed = true;
+							else ++seen[id];
+						}
+						return true;
+					});
+					for (int id = 0; id < steps * perStep; ++id)
+						if (seen[id] != (id >= std::max(g - 1, 0) * perStep && id < (g + 1) * perStep)) failed = true;
+					if (count != t.GetStats().elementCount) failed = true;
+				});
+			}
+		});
+	}
+	std::vector<QNodeEleHandle> handles;
+	for (int g = 0; g < steps; ++g) {
+		for (int i = 0; i < perStep; ++i) {
+			const std::uintptr_t id = g * perStep + i;
+			handles.push_back(ct.Insert(QNodeEle(rectOf(id), (void*)id)));
+		}
+		if (g >= 2)
+			for (int i = 0; i < perStep; ++i) ct.Erase(handles[(g - 2) * perStep + i]);
+		const float x = qtRect.l + (g + 1) * 0.5f;
+		ct.Move(markerHandle, QTRect(x, qtRect.t, x + 1, qtRect.t + 1));
+		ct.Cleanup(16);
+		ct.Publish();
+	}
+	done = true;
+	for (auto& reader : readers) reader.join();
+	if (failed) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+}
+
+void StartTest() {
+	QuadTree qt = QuadTree(qtRect);
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		if (eraseReg[i] != -1) {
+			// erase half of the elements by value and the other half by handle
+			if (i & 1) qt.Erase(handleReg[eraseReg[i]]);
+			else qt.Erase(randEle[eraseReg[i]]);
+		}
+		if (cleanupReg[i]) qt.Cleanup();
+		handleReg[i] = qt.Insert(randEle[i]);
+	}
+	qt.Cleanup();
+	std::cout << "check~" << std::endl;
+	CheckTree(qt);
+	// the budgeted Cleanup refreshes a little of the dirty part every step,
+	// once no dirty node is left the tree is the one of a full Cleanup
+	QuadTree bct = QuadTree(qtRect);
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		if (eraseReg[i] != -1) bct.Erase(randEle[eraseReg[i]]);
+		if (cleanupReg[i]) bct.Cleanup();
+		else bct.Cleanup(16);
+		bct.Insert(randEle[i]);
+	}
+	while (!bct.Cleanup(16));
+	CheckTree(bct);
+	if (bct.GetStats().nodeCount != qt.GetStats().nodeCount) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// compacting keeps every element where queries and handles find it
+	qt.Compact();
+	CheckTree(qt);
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		if (qt.IsValid(handleReg[i]) != eleExistReg[i] || qt.GetStats().freeNodeSlots != 0) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	// the remaining elements built at once must give the same result
+	std::vector<QNodeEle> remain;
+	for (unsigned int i = 0; i < numOfEle; ++i)
+		if (eleExistReg[i]) remain.push_back(randEle[i]);
+	QuadTree bt = QuadTree(qtRect, remain.data(), remain.data() + remain.size());
+	CheckTree(bt);
+	// the stats count every element once
+	QTStats stats = bt.GetStats();
+	if (stats.elementCount != static_cast<int>(remain.size()) || stats.nodeCount != stats.nodeSlots - stats.freeNodeSlots) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// a tree of known layout: root splits once, its top left child once more, and the top left leaf
+	// of that one is at maxDepth with 7 elements. leaves are 3 at depth 2 and 4 at depth 3
+	const float knownPoints[][2] = { { 80, 80 }, { 15, 15 }, { 15, 45 }, { 45, 15 }, { 45, 45 },
+		{ 12, 12 }, { 14, 14 }, { 16, 16 }, { 18, 18 }, { 20, 20 }, { 25, 25 } };
+	QuadTree kt = QuadTree(qtRect, 3, 4);
+	for (auto& p : knownPoints) kt.Insert(QNodeEle(QTRect(p[0], p[1], p[0] + 1, p[1] + 1)));
+	const QTStats knownStats = kt.GetStats();
+	if (knownStats.nodeCount != 9 || knownStats.leafCount != 7 || knownStats.maxDepth != 3 ||
+		knownStats.averageDepth != 18.0 / 7 || knownStats.leafHistogram != std::vector<int>({ 2, 4, 0, 0, 0, 1 }) ||
+		knownStats.overfullLeafCount != 1 || knownStats.largestLeaf != 7) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+#ifdef QUADTREE_QUERY_STATS
+	// a query at the first element of the full leaf visits root, its top left child and that leaf,
+	// one at the bottom right element visits root and its leaf
+	QueryScratch countedScratch;
+	kt.Query(QTPoint(15.5f, 15.5f), [](const QNodeEle&) { return true; }, countedScratch);
+	kt.Query(QTPoint(80.5f, 80.5f), [](const QNodeEle&) { return true; }, countedScratch);
+	const QTQueryCounters& counters = countedScratch.counters;
+	if (counters.queries != 2 || counters.nodesVisited != 5 || counters.elementTests != 8 || counters.hits != 2) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+#endif
+	// a snapshot loads without inserting, and its view answers the same queries in place
+	std::vector<unsigned long long> aligned;
+	const std::size_t snapshotSize = SaveTree(bt, aligned);
+	QuadTree st = QuadTree(qtRect);
+	LoadTree(st, aligned, snapshotSize);
+	CheckTree(st);
+	QuadTreeView view;
+	view.Open(aligned.data(), snapshotSize);
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		bool cp = false;
+		view.Query(GetRectCenter(randEle[i].rect), [&](const QTRect& rect, unsigned long long id) {
+			if (rect == randEle[i].rect && id == reinterpret_cast<std::uintptr_t>(randEle[i].vPtr)) cp = true;
+			return true;
+		});
+		if (cp != eleExistReg[i]) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	// a snapshot loaded into a tree in use gives handles of its elements, in the order of payloadOf,
+	// which move and erase them, and the handles of the old elements are invalid
+	QuadTree ut = QuadTree(qtRect);
+	std::vector<QNodeEleHandle> usedHandles;
+	for (unsigned int i = 0; i < numOfEle; ++i) usedHandles.push_back(ut.Insert(randEle[i]));
+	for (unsigned int i = 0; i < numOfEle; i += 3) ut.Erase(usedHandles[i]);
+	std::vector<std::size_t> loadedIds;
+	std::vector<QNodeEleHandle> loadedHandles(remain.size());
+	if (!ut.Load(aligned.data(), snapshotSize, [&](unsigned long long id) {
+		loadedIds.push_back(static_cast<std::size_t>(id));
+		return reinterpret_cast<void*>(static_cast<std::uintptr_t>(id)); }, loadedHandles.data()) ||
+		loadedIds.size() != remain.size()) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	for (auto& h : usedHandles) {
+		if (ut.IsValid(h)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	for (std::size_t k = 0; k < loadedIds.size(); ++k) {
+		// one step toward the center of root, so it stays inside
+		const QNodeEle& e = randEle[loadedIds[k]];
+		const QTPoint c = GetRectCenter(e.rect);
+		const float dx = c.x < 55 ? 1.0f : -1.0f, dy = c.y < 55 ? 1.0f : -1.0f;
+		const QNodeEle moved(QTRect(e.rect.l + dx, e.rect.t + dy, e.rect.r + dx, e.rect.b + dy), e.vPtr);
+		if (!ut.Move(loadedHandles[k], moved.rect) || !HasEle(ut, moved) || HasEle(ut, e) ||
+			!ut.Erase(loadedHandles[k]) || HasEle(ut, moved)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	if (ut.GetStats().elementCount != 0) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// a tree of root only, empty or with fewer elements than a leaf holds, round trips too
+	for (unsigned int n = 0; n < 4; n += 3) {
+		QuadTree rt = QuadTree(qtRect);
+		for (unsigned int i = 0; i < n; ++i) rt.Insert(remain[i]);
+		std::vector<unsigned long long> rootData;
+		const std::size_t rootSize = SaveTree(rt, rootData);
+		QuadTree rl = QuadTree(qtRect);
+		QuadTreeView rv;
+		if (!LoadTree(rl, rootData, rootSize) || !rv.Open(rootData.data(), rootSize) ||
+			rv.Size() != static_cast<int>(n) || rl.GetStats().elementCount != static_cast<int>(n)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+		for (unsigned int i = 0; i < n; ++i) {
+			if (!HasEle(rl, remain[i])) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+		}
+	}
+	// a truncated snapshot, a leaf with a wrong count, a child out of the nodes and a group reached twice
+	// are refused by the tree and the view, and the tree stays as it was
+	std::vector<std::vector<unsigned long long>> corrupt(3, aligned);
+	const QTSnapshotNodeT<float>* snapshotNodes = SnapshotNodes(aligned);
+	const int nodeCount = reinterpret_cast<const QTSnapshotHeader*>(aligned.data())->nodeCount;
+	for (int i = 0; i < nodeCount; ++i) {
+		if (snapshotNodes[i].count == -1) continue;
+		SnapshotNodes(corrupt[0])[i].count += 1;
+		break;
+	}
+	SnapshotNodes(corrupt[1])[0].count = -1;
+	SnapshotNodes(corrupt[1])[0].first_child = nodeCount;
+	if (snapshotNodes[0].count == -1) {
+		SnapshotNodes(corrupt[2])[snapshotNodes[0].first_child].count = -1;
+		SnapshotNodes(corrupt[2])[snapshotNodes[0].first_child].first_child = snapshotNodes[0].first_child;
+	}
+	else corrupt[2].clear();
+	QuadTreeView cv;
+	if (LoadTree(st, aligned, snapshotSize - 8) || cv.Open(aligned.data(), snapshotSize - 8)) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	for (auto& data : corrupt) {
+		if (!data.empty() && (LoadTree(st, data, snapshotSize) || cv.Open(data.data(), snapshotSize))) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	CheckTree(st);
+	// and so must the parallel build
+	static QTThreadPool pool;
+	QuadTree pt = QuadTree(qtRect);
+	pt.Build(remain.data(), remain.data() + remain.size(), pool);
+	CheckTree(pt);
+	// the loose mode keeps large elements at upper nodes, queries must agree
+	QuadTree lt = QuadTree(qtRect, 5, 4, 2);
+	for (auto& e : remain) lt.Insert(e);
+	CheckTree(lt);
+	lt.Build(remain.data(), remain.data() + remain.size(), pool);
+	CheckTree(lt);
+	// the bulk-load constructor takes the loose mode and autoGrow too
+	QuadTree lbt = QuadTree(qtRect, remain.data(), remain.data() + remain.size(), 5, 4, nullptr, 2);
+	CheckTree(lbt);
+	if (lbt.GetStats().nodeCount != lt.GetStats().nodeCount) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// a root much smaller than the elements grows to hold them, and shrinks back once they are erased
+	QuadTree gt = QuadTree({ 10, 10, 20, 20 }, 3, 4, 0, true);
+	std::vector<QNodeEleHandle> grownHandles;
+	for (auto& e : remain) grownHandles.push_back(gt.Insert(e));
+	CheckTree(gt);
+	QuadTree gbt = QuadTree({ 10, 10, 20, 20 }, remain.data(), remain.data() + remain.size(), 3, 4, nullptr, 0, true);
+	CheckTree(gbt);
+	if (gbt.GetStats().nodeCount != gt.GetStats().nodeCount) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	for (auto& h : grownHandles) gt.Erase(h);
+	gt.Cleanup();
+	// maxDepth 0 splits crowded leaves as deep as their elements allow, sparse ones merge back on Cleanup
+	QuadTree at = QuadTree(qtRect, 0, 4);
+	for (auto& e : remain) at.Insert(e);
+	CheckTree(at);
+	// inserting, building and building in parallel split by the same rule
+	const int insertedNodes = at.GetStats().nodeCount;
+	at.Build(remain.data(), remain.data() + remain.size());
+	const int builtNodes = at.GetStats().nodeCount;
+	at.Build(remain.data(), remain.data() + remain.size(), pool);
+	CheckTree(at);
+	if (insertedNodes != builtNodes || builtNodes != at.GetStats().nodeCount) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	for (unsigned int i = 0; i < numOfEle; ++i)
+		if (!eleExistReg[i]) at.Insert(randEle[i]);
+	for (unsigned int i = 0; i < numOfEle; ++i)
+		if (!eleExistReg[i]) at.Erase(randEle[i]);
+	at.Cleanup();
+	CheckTree(at);
+	// coincident elements can't be told apart by a split, they stay in one leaf however many they are,
+	// until an element elsewhere splits it once
+	std::vector<QNodeEle> coincident;
+	for (unsigned int i = 0; i < 5; ++i) coincident.push_back(QNodeEle(QTRect(30, 30, 31, 31), (void*)i));
+	for (int extra = 0; extra < 2; ++extra) {
+		const int expected = extra ? 5 : 1;
+		for (int depth = 0; depth < 5; depth += 3) {
+			QuadTree dupt = QuadTree(qtRect, depth, 4);
+			for (auto& e : coincident) dupt.Insert(e);
+			const int insertedDup = dupt.GetStats().nodeCount;
+			dupt.Build(coincident.data(), coincident.data() + coincident.size());
+			const int builtDup = dupt.GetStats().nodeCount;
+			dupt.Build(coincident.data(), coincident.data() + coincident.size(), pool);
+			if (insertedDup != expected || builtDup != expected || dupt.GetStats().nodeCount != expected) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+			for (auto& e : coincident) {
+				if (!HasEle(dupt, e)) {
+					std::cout << "wrong!" << std::endl;
+					throw("error");
+				}
+			}
+		}
+		coincident.push_back(QNodeEle(QTRect(80, 80, 81, 81), (void*)5));
+	}
+	// a runtime maxDepth beyond QT_MAX_DEPTH is clamped, the morton codes of a build still hold every level
+	// and each element is erased by value. every level splits one element off the chain to the corner,
+	// and the elements piled at its end are enough for the parallel build to split down there too
+	{
+		typedef BasicQuadTree<int, double> DeepTree;
+		std::vector<DeepTree::Element> deep;
+		for (int k = 0; k < 1100; ++k) {
+			const double x = 10 + 90 * 0.75 * std::ldexp(1.0, -std::min(k, 39));
+			deep.push_back(DeepTree::Element({ x, x, x, x }, k));
+		}
+		DeepTree dt({ 10, 10, 100, 100 }, 40, 4);
+		for (int parallel = 0; parallel < 2; ++parallel) {
+			if (parallel) dt.Build(deep.data(), deep.data() + deep.size(), pool);
+			else dt.Build(deep.data(), deep.data() + deep.size());
+			if (dt.GetStats().maxDepth != QT_MAX_DEPTH) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+			for (auto& e : deep) {
+				if (!dt.Erase(e)) {
+					std::cout << "wrong!" << std::endl;
+					throw("error");
+				}
+			}
+			if (dt.GetStats().elementCount != 0) {
+				std::cout << "wrong!" << std::endl;
+				throw("error");
+			}
+		}
+	}
+	// payloads by value with int and double coordinates, and the bookkeeping of an element takes 8 bytes
+	BasicQuadTree<int, int> intTree(QTRectT<int>(10, 10, 100, 100));
+	CheckTypedTree(intTree, remain);
+	BasicQuadTree<int, double> doubleTree(QTRectT<double>(10, 10, 100, 100), 5, 4, 2);
+	CheckTypedTree(doubleTree, remain);
+	if (sizeof(QNodeEleInfo) != 8) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// batch of the same point queries
+	std::vector<QTPoint> points;
+	for (unsigned int i = 0; i < numOfEle; ++i)
+		points.push_back(GetRectCenter(randEle[i].rect));
+	QueryBatchResult batch;
+	pt.QueryBatch(points.data(), points.data() + points.size(), batch, pool);
+	for (unsigned int i = 0; i < numOfEle; ++i) {
+		bool cp = false;
+		for (int h = batch.offsets[i]; h < batch.offsets[i + 1]; ++h)
+			if (batch.hits[h] == randEle[i]) cp = true;
+		if (cp != eleExistReg[i]) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	// a hard capacity keeps leaves whole instead of splitting, every element must still be found
+	QuadTree ht = QuadTree(qtRect);
+	ht.Reserve(64, static_cast<int>(remain.size()), true);
+	for (auto& e : remain) ht.Insert(e);
+	CheckTree(ht);
+	if (ht.GetStats().nodeSlots > 64 || ht.IsValid(ht.Insert(QNodeEle(qtRect)))) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// every array of the tree comes from the allocator
+	// and goes back to it, an empty tree has root and the half sizes of every depth
+	countedBytes = 0;
+	{
+		BasicQuadTree<void*, float, 0, 0, CountingAllocator<char>> cat(qtRect, 3);
+		const std::size_t emptyBytes = countedBytes;
+		cat.Build(remain.data(), remain.data() + remain.size(), pool);
+		for (unsigned int i = 0; i < numOfEle; ++i)
+			if (!eleExistReg[i]) cat.Insert(randEle[i]);
+		if (emptyBytes < sizeof(QTPoint) * 4 + sizeof(QNodeT<float>) + sizeof(QNodeEles) || countedBytes <= emptyBytes) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	if (countedBytes != 0) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// limits fixed at compile time: the runtime arguments are ignored, a leaf allocates its elements
+	// once until it splits, and a snapshot of other limits is refused
+	{
+		typedef BasicQuadTree<void*, float, 4, 8, CountingAllocator<char>> FixedTree;
+		FixedTree ft(qtRect, 9, 2);
+		ft.Reserve(1, 8);
+		ft.Insert(remain[0]);
+		const std::size_t leafBytes = countedBytes;
+		for (unsigned int i = 1; i < 8; ++i) ft.Insert(remain[i]);
+		if (countedBytes != leafBytes || ft.GetStats().nodeCount != 1) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+		for (unsigned int i = 8; i < remain.size(); ++i) ft.Insert(remain[i]);
+		CheckTree(ft);
+		const QTStats fixedStats = ft.GetStats();
+		if (fixedStats.maxDepth > 4 || fixedStats.leafHistogram.size() != 10) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+		std::vector<unsigned long long> fixedData;
+		const std::size_t fixedSize = SaveTree(ft, fixedData);
+		const QTSnapshotHeader* fixedHeader = reinterpret_cast<const QTSnapshotHeader*>(fixedData.data());
+		FixedTree fl(qtRect);
+		if (fixedHeader->maxDepth != 4 || fixedHeader->maxElePerLeaf != 8 || !LoadTree(fl, fixedData, fixedSize)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+		// bt is 3 levels of 4, and one of 4 levels and 4 elements per leaf differs in the leaves only
+		std::vector<unsigned long long> leafData;
+		const std::size_t leafSize = SaveTree(QuadTree(qtRect, remain.data(), remain.data() + remain.size(), 4, 4), leafData);
+		if (LoadTree(fl, aligned, snapshotSize) || LoadTree(fl, leafData, leafSize)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+		CheckTree(fl);
+	}
+	if (countedBytes != 0) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	// a moved element is found at its new rect only, in its old leaf or in another one,
+	// and its handle still erases it
+	std::vector<QNodeEleHandle> moveHandles(remain.size());
+	QuadTree mt = QuadTree(qtRect, remain.data(), remain.data() + remain.size(), 3, 4, moveHandles.data());
+	for (unsigned int i = 0; i < remain.size(); ++i) {
+		const QTPoint c = GetRectCenter(remain[i].rect);
+		// the same center stays in the leaf, the mirrored one is in another quadrant of root
+		const QNodeEle inLeaf(QTRect(c.x - 0.5f, c.y - 0.5f, c.x + 0.5f, c.y + 0.5f), remain[i].vPtr);
+		const float mx = qtRect.l + qtRect.r - c.x, my = qtRect.t + qtRect.b - c.y;
+		const QNodeEle toLeaf(QTRect(mx - 1, my - 1, mx + 1, my + 1), remain[i].vPtr);
+		if (!mt.Move(moveHandles[i], inLeaf.rect) || !HasEle(mt, inLeaf) ||
+			!mt.Move(moveHandles[i], toLeaf.rect) || !HasEle(mt, toLeaf) || HasEle(mt, inLeaf) ||
+			!mt.Move(moveHandles[i], remain[i].rect) || HasEle(mt, toLeaf)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	mt.Cleanup();
+	CheckTree(mt);
+	for (unsigned int i = 0; i < remain.size(); ++i) {
+		if (!mt.Erase(moveHandles[i]) || mt.IsValid(moveHandles[i]) || HasEle(mt, remain[i])) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	}
+	// pairs across the center of root, and in the loose mode pairs of a large element kept by a branch
+	// and the elements of its children
+	std::vector<QNodeEle> pairEles = remain;
+	pairEles.push_back(QNodeEle(QTRect(50, 50, 60, 60), (void*)numOfEle));
+	pairEles.push_back(QNodeEle(QTRect(20, 20, 90, 90), (void*)(numOfEle + 1)));
+	CheckPairs(QuadTree(qtRect, pairEles.data(), pairEles.data() + pairEles.size()), pairEles);
+	QuadTree lpt = QuadTree(qtRect, 5, 4, 2);
+	for (auto& e : pairEles) lpt.Insert(e);
+	CheckPairs(lpt, pairEles);
+	// a join of two trees with different layouts, either one first
+	std::vector<QNodeEle> gone;
+	for (unsigned int i = 0; i < numOfEle; ++i)
+		if (!eleExistReg[i]) gone.push_back(randEle[i]);
+	gone.push_back(pairEles[pairEles.size() - 2]);
+	gone.push_back(pairEles[pairEles.size() - 1]);
+	QuadTree jt = QuadTree(qtRect, 5, 2, 2);
+	for (auto& e : gone) jt.Insert(e);
+	CheckJoin(bt, jt, remain, gone);
+	CheckJoin(jt, bt, gone, remain);
+	// nearest elements without a limit and within a distance, in both layouts
+	CheckNearest(bt, remain, 1000);
+	CheckNearest(lt, remain, 10);
+	// rays in both layouts
+	CheckRaycast(bt, remain);
+	CheckRaycast(lt, remain);
+	// shape queries in both layouts
+	CheckShapes(bt, remain);
+	CheckShapes(lt, remain);
+	// a reader sees the published copy only
+	ConcurrentQuadTree ct(qtRect);
+	ct.Build(remain.data(), remain.data() + remain.size());
+	ct.Publish();
+	ct.Insert(QNodeEle(qtRect));
+	ct.Read([](const QuadTree& t) { CheckTree(t); });
+	// a hard capacity reaches the published copy on Publish, then both copies refuse the same inserts
+	ct.Reserve(64, static_cast<int>(remain.size()) + 1, true);
+	ct.Publish();
+	if (ct.Writing().IsValid(ct.Insert(QNodeEle(qtRect)))) {
+		std::cout << "wrong!" << std::endl;
+		throw("error");
+	}
+	ct.Publish();
+	const int written = ct.Writing().GetStats().elementCount;
+	ct.Read([written](const QuadTree& t) {
+		CheckTree(t);
+		if (t.GetStats().elementCount != written || written != static_cast<int>(t.GetStats().eleInfoSlots)) {
+			std::cout << "wrong!" << std::endl;
+			throw("error");
+		}
+	});
+	// readers on other threads see whole steps of the writer
+	ConcurrentQuadTree mct(qtRect);
+	CheckPublishedSteps(mct);
+}
+
 void main() {
 	LARGE_INTEGER BegainTime;
 	LARGE_INTEGER EndTime;
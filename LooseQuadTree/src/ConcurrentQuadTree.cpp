@@ -0,0 +1,14 @@
+#ifndef QUADTREE_API_DLL
+#ifdef _WIN32
+#define QUADTREE_API_DLL __declspec(dllexport)
+#else
+#define QUADTREE_API_DLL
+#endif
+#endif
+#include "ConcurrentQuadTree.h"
+
+namespace LQT {
+
+	template class QUADTREE_API_DLL BasicConcurrentQuadTree<void*, float>;
+
+}
@@ -0,0 +1,254 @@
+#pragma once
+#include "QuadTree.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace LQT { // loose quad tree
+
+	// BasicQuadTree for one writer thread and any number of reader threads.
+	// it keeps two copies of the tree, readers use the published one and the writer changes the other.
+	// Publish swaps them, waits until no reader uses the old copy and repeats the logged changes on it,
+	// so readers never block and the cost of a publish is the size of the changes
+	template<typename Payload, typename Coord = float, int MaxDepth = 0, int MaxElePerLeaf = 0,
+		typename Alloc = std::allocator<char>>
+	class BasicConcurrentQuadTree {
+	public:
+		typedef BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc> Tree;
+		typedef typename Tree::Rect Rect;
+		typedef typename Tree::Point Point;
+		typedef typename Tree::Element Element;
+		typedef typename Tree::Real Real;
+		BasicConcurrentQuadTree(Rect rect, int maxDepth = 3,
+			int maxElePerLeaf = 4, Real looseFactor = 0, bool autoGrow = false, const Alloc& alloc = Alloc());
+		BasicConcurrentQuadTree(const BasicConcurrentQuadTree&) = delete;
+		BasicConcurrentQuadTree& operator=(const BasicConcurrentQuadTree&) = delete;
+		// writer only, the changes are invisible to readers until Publish.
+		// both copies give the same handles since they see the same changes
+		void Build(const Element* first, const Element* last, QNodeEleHandle* handles = nullptr);
+		// an insert which fails for the hard capacity isn't logged, so both copies fail alike
+		QNodeEleHandle Insert(const Element& ele);
+		bool Erase(const Element& ele);
+		bool Erase(const QNodeEleHandle& handle);
+		bool Move(const QNodeEleHandle& handle, const Rect& rect);
+		void Cleanup();
+		bool Cleanup(int maxNodes);
+		void Compact();
+		// reserve in the writer's copy, the other one reserves on Publish as for every change
+		void Reserve(int nodeCount, int eleCount, bool hardCapacity = false);
+		void Publish();
+		// the copy changed by the writer, only the writer may use it
+		const Tree& Writing() const;
+		// reader(const Tree&) reads the published copy, which isn't changed until it returns
+		template<typename F>
+		void Read(F&& reader) const;
+		// same as BasicQuadTree::Query on the published copy
+		template<typename F>
+		bool Query(const Rect& rect, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+		template<typename F>
+		bool Query(const Point& point, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+		template<typename S, typename F>
+		bool Query(const S& shape, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+	private:
+		struct Change {
+			enum Type { BUILD, INSERT, ERASE_ELE, ERASE_HANDLE, MOVE, CLEANUP, CLEANUP_DIRTY, COMPACT, RESERVE } type;
+			Element ele;
+			QNodeEleHandle handle;
+			// elements of BUILD
+			std::vector<Element> eles;
+			// budget of CLEANUP_DIRTY
+			int maxNodes;
+			// arguments of RESERVE
+			int nodeCount;
+			int eleCount;
+			bool hardCapacity;
+			Change(Type type, const Element& ele = {}, const QNodeEleHandle& handle = {})
+				: type(type), ele(ele), handle(handle), maxNodes(0), nodeCount(0), eleCount(0), hardCapacity(false) {}
+		};
+		void apply(Tree& tree, const Change& change);
+	private:
+		Tree trees[2];
+		// index of the published copy
+		std::atomic<int> published;
+		// readers[i] is the number of readers in trees[i]
+		mutable std::atomic<int> readers[2];
+		// changes which are not applied to the published copy yet
+		std::vector<Change> changes;
+	};
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::BasicConcurrentQuadTree(Rect rect, int maxDepth, int maxElePerLeaf, Real looseFactor, bool autoGrow, const Alloc& alloc)
+		: trees{ Tree(rect, maxDepth, maxElePerLeaf, looseFactor, autoGrow, alloc), Tree(rect, maxDepth, maxElePerLeaf, looseFactor, autoGrow, alloc) },
+		published(0) {
+		readers[0] = 0;
+		readers[1] = 0;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Build(const Element* first, const Element* last, QNodeEleHandle* handles) {
+		Change change(Change::BUILD);
+		change.eles.assign(first, last);
+		trees[1 - published].Build(first, last, handles);
+		changes.push_back(std::move(change));
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	QNodeEleHandle BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Insert(const Element& ele) {
+		const QNodeEleHandle handle = trees[1 - published].Insert(ele);
+		if (handle.idx != -1) changes.push_back(Change(Change::INSERT, ele));
+		return handle;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Erase(const Element& ele) {
+		if (!trees[1 - published].Erase(ele)) return false;
+		changes.push_back(Change(Change::ERASE_ELE, ele));
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Erase(const QNodeEleHandle& handle) {
+		if (!trees[1 - published].Erase(handle)) return false;
+		changes.push_back(Change(Change::ERASE_HANDLE, {}, handle));
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Move(const QNodeEleHandle& handle, const Rect& rect) {
+		if (!trees[1 - published].Move(handle, rect)) return false;
+		changes.push_back(Change(Change::MOVE, Element(rect), handle));
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Cleanup() {
+		trees[1 - published].Cleanup();
+		changes.push_back(Change(Change::CLEANUP));
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Cleanup(int maxNodes) {
+		// the other copy has the same dirty nodes, so it stops at the same node
+		Change change(Change::CLEANUP_DIRTY);
+		change.maxNodes = maxNodes;
+		changes.push_back(change);
+		return trees[1 - published].Cleanup(maxNodes);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Compact() {
+		trees[1 - published].Compact();
+		changes.push_back(Change(Change::COMPACT));
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Reserve(int nodeCount, int eleCount, bool hardCapacity) {
+		Change change(Change::RESERVE);
+		change.nodeCount = nodeCount;
+		change.eleCount = eleCount;
+		change.hardCapacity = hardCapacity;
+		trees[1 - published].Reserve(nodeCount, eleCount, hardCapacity);
+		changes.push_back(change);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Publish() {
+		const int old = published;
+		published = 1 - old;
+		// readers which entered the old copy before the swap are counted, wait for them
+		while (readers[old].load() != 0)
+			std::this_thread::yield();
+		for (const Change& change : changes)
+			apply(trees[old], change);
+		changes.clear();
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	const BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>& BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Writing() const {
+		return trees[1 - published];
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	void BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Read(F&& reader) const {
+		while (true) {
+			const int i = published.load();
+			readers[i].fetch_add(1);
+			// if Publish swapped the copies in between, the writer may not see this reader
+			if (published.load() == i) {
+				reader(static_cast<const Tree&>(trees[i]));
+				readers[i].fetch_sub(1);
+				return;
+			}
+			readers[i].fetch_sub(1);
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const Rect& rect, F&& onHit, QueryScratch& scratch) const {
+		bool hit = false;
+		Read([&](const Tree& tree) { hit = tree.Query(rect, onHit, scratch); });
+		return hit;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const Point& point, F&& onHit, QueryScratch& scratch) const {
+		bool hit = false;
+		Read([&](const Tree& tree) { hit = tree.Query(point, onHit, scratch); });
+		return hit;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename S, typename F>
+	bool BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const S& shape, F&& onHit, QueryScratch& scratch) const {
+		bool hit = false;
+		Read([&](const Tree& tree) { hit = tree.Query(shape, onHit, scratch); });
+		return hit;
+	}
+
+	/*=======
+	! PRIVATE !
+	=======*/
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicConcurrentQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::apply(Tree& tree, const Change& change) {
+		switch (change.type) {
+		case Change::BUILD:
+			tree.Build(change.eles.data(), change.eles.data() + change.eles.size());
+			break;
+		case Change::INSERT:
+			tree.Insert(change.ele);
+			break;
+		case Change::ERASE_ELE:
+			tree.Erase(change.ele);
+			break;
+		case Change::ERASE_HANDLE:
+			tree.Erase(change.handle);
+			break;
+		case Change::MOVE:
+			tree.Move(change.handle, change.ele.rect);
+			break;
+		case Change::CLEANUP:
+			tree.Cleanup();
+			break;
+		case Change::CLEANUP_DIRTY:
+			tree.Cleanup(change.maxNodes);
+			break;
+		case Change::COMPACT:
+			tree.Compact();
+			break;
+		case Change::RESERVE:
+			tree.Reserve(change.nodeCount, change.eleCount, change.hardCapacity);
+			break;
+		}
+	}
+
+	typedef BasicConcurrentQuadTree<void*, float> ConcurrentQuadTree;
+	extern template class QUADTREE_API_DLL BasicConcurrentQuadTree<void*, float>;
+
+}
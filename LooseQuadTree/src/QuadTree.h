@@ -1,80 +1,229 @@
 #ifndef QUADTREE_API_DLL
+#ifdef _WIN32
 #define QUADTREE_API_DLL __declspec(dllimport)
+#else
+#define QUADTREE_API_DLL
+#endif
 #endif // QUANDTREE_API_DLL
 #pragma once
-#include "FreeList.h"
+#include "ThreadPool.h"
+#include <vector>
 #include <list>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <cstring>
+#include <cstdint>
+
+// test four rects at once with SSE, define QUADTREE_NO_SIMD to use the scalar version
+#if !defined(QUADTREE_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define QUADTREE_USE_SSE
+#include <xmmintrin.h>
+#endif
 
 namespace LQT { // loose quad tree
 
-	struct QUADTREE_API_DLL QTRect {
-		float l, r, t, b;
-		QTRect(float l = 0, float t = 0, float r = 0, float b = 0)
+	// floating type of distances and ray parameters, double for double coordinates and float for others
+	template<typename Coord>
+	struct QTReal {
+		typedef float type;
+	};
+	template<>
+	struct QTReal<double> {
+		typedef double type;
+	};
+
+	template<typename Coord>
+	struct QTRectT {
+		Coord l, r, t, b;
+		QTRectT(Coord l = 0, Coord t = 0, Coord r = 0, Coord b = 0)
 			: l(l), r(r), t(t), b(b) {}
-		bool operator==(const QTRect& rhs) const {
+		bool operator==(const QTRectT& rhs) const {
 			return rhs.l == l && rhs.r == r &&
 				rhs.t == t && rhs.b == b;
 		}
 	};
-	struct QUADTREE_API_DLL QTPoint {
-		float x, y;
-		QTPoint(float x = 0, float y = 0)
+	template<typename Coord>
+	struct QTPointT {
+		Coord x, y;
+		QTPointT(Coord x = 0, Coord y = 0)
 			: x(x), y(y) {}
-		bool operator==(const QTPoint& rhs) const {
+		bool operator==(const QTPointT& rhs) const {
 			return rhs.x == x && rhs.y == y;
 		}
-		QTPoint& operator/(const float& rhs) {
+		QTPointT& operator/(const Coord& rhs) {
 			x /= rhs; y /= rhs; return *this;
 		}
-		QTPoint& operator*(const float& rhs) {
+		QTPointT& operator*(const Coord& rhs) {
 			x *= rhs; y *= rhs; return *this;
 		}
-		QTPoint& operator+(const QTPoint& rhs) {
+		QTPointT& operator+(const QTPointT& rhs) {
 			x += rhs.x; y += rhs.y; return *this;
 		}
-		QTPoint& operator-(const QTPoint& rhs) {
+		QTPointT& operator-(const QTPointT& rhs) {
 			x -= rhs.x; y -= rhs.y; return *this;
 		}
 	};
-	struct QUADTREE_API_DLL QNode {
+	// four rects in structure-of-arrays layout, lane i is the i-th rect
+	template<typename Coord>
+	struct QTRect4T {
+		Coord l[4], r[4], t[4], b[4];
+		QTRect4T() {
+			for (int i = 0; i < 4; ++i) l[i] = r[i] = t[i] = b[i] = 0;
+		}
+		QTRectT<Coord> Get(const int& i) const {
+			return { l[i], t[i], r[i], b[i] };
+		}
+		void Set(const int& i, const QTRectT<Coord>& rect) {
+			l[i] = rect.l; r[i] = rect.r; t[i] = rect.t; b[i] = rect.b;
+		}
+	};
+	typedef QTRectT<float> QTRect;
+	typedef QTPointT<float> QTPoint;
+	typedef QTRect4T<float> QTRect4;
+	template<typename Coord>
+	struct QNodeT {
 		// it will be the index of the first sub branch
-		// or it will be the first ele index
+		// or -1 if it's a leaf, leaf's elements are in nodeEles
 		int first_child;
 		// loose AABB
-		QTRect aabbRect;
+		QTRectT<Coord> aabbRect;
 		// count = -1 if this node is a branch or
 		// it's a leaf and count means the number of ele
 		int count;
-		QNode(int first_child = -1, int count = 0)
-			: first_child(first_child), count(count) {}
+		// an element under this node was erased or moved since the last cleanup,
+		// so aabbRect may be larger than needed or the node may be empty
+		bool dirty;
+		QNodeT(int first_child = -1, int count = 0)
+			: first_child(first_child), count(count), dirty(false) {}
 	};
-	struct QUADTREE_API_DLL QNodeEle {
+	typedef QNodeT<float> QNode;
+	// element of BasicQuadTree, the payload is stored in the tree by value,
+	// so a small one such as an entity id doesn't cost a pointer
+	template<typename Payload, typename Coord = float>
+	struct QTElement {
+		QTRectT<Coord> rect;
+		Payload payload;
+		QTElement(const QTRectT<Coord>& rect = {}, const Payload& payload = Payload())
+			: rect(rect), payload(payload) {}
+		const Payload& GetPayload() const {
+			return payload;
+		}
+		bool operator==(const QTElement& e) const {
+			return e.rect == rect && e.payload == payload;
+		}
+	};
+	// element of QuadTree, its payload keeps the name vPtr
+	template<>
+	struct QTElement<void*, float> {
 		QTRect rect;
 		void* vPtr;
-		QNodeEle(const QTRect& rect = { 0, 0, 0, 0 }, void* vPtr = nullptr)
+		QTElement(const QTRect& rect = { 0, 0, 0, 0 }, void* vPtr = nullptr)
 			: rect(rect), vPtr(vPtr) {}
-		bool operator==(const QNodeEle& e) const {
+		void* const& GetPayload() const {
+			return vPtr;
+		}
+		bool operator==(const QTElement& e) const {
 			return e.rect == rect && e.vPtr == vPtr;
 		}
 	};
-	struct QUADTREE_API_DLL QNodeElePtr {
-		int eleIdx;
-		// point to next eleptr index,
-		// -1 means this is the end of the list
-		int next;
-		QNodeElePtr(int eleidx = -1, int next = -1)
-			:eleIdx(eleidx), next(next) {}
+	typedef QTElement<void*, float> QNodeEle;
+	// vector of T which allocates with Alloc rebound to T
+	template<typename T, typename Alloc>
+	using QTVector = std::vector<T, typename std::allocator_traits<Alloc>::template rebind_alloc<T>>;
+	// elements of a leaf in structure-of-arrays layout, so a leaf is scanned linearly.
+	// an element takes a rect, its payload and its id here and a QNodeEleInfo in the tree,
+	// 32 bytes with float and a 32 bit payload or 36 with void*, about 4 more with the nodes
+	template<typename Payload, typename Coord, typename Alloc = std::allocator<char>>
+	struct QNodeElesT {
+		typedef QTElement<Payload, Coord> Element;
+		// rect of element i is rects[i / 4].Get(i % 4)
+		QTVector<QTRect4T<Coord>, Alloc> rects;
+		QTVector<Payload, Alloc> payloads;
+		// index of element i in eleInfos
+		QTVector<int, Alloc> ids;
+		explicit QNodeElesT(const Alloc& alloc = Alloc())
+			: rects(alloc), payloads(alloc), ids(alloc) {}
+		QTRectT<Coord> GetRect(const int& i) const {
+			return rects[i >> 2].Get(i & 3);
+		}
+		Element Get(const int& i) const {
+			return { GetRect(i), payloads[i] };
+		}
+		void SetRect(const int& i, const QTRectT<Coord>& rect) {
+			rects[i >> 2].Set(i & 3, rect);
+		}
+		void Set(const int& i, const Element& ele, const int& id) {
+			SetRect(i, ele.rect);
+			payloads[i] = ele.GetPayload();
+			ids[i] = id;
+		}
+		void Push(const Element& ele, const int& id) {
+			if ((ids.size() & 3) == 0) rects.push_back({});
+			rects.back().Set(ids.size() & 3, ele.rect);
+			payloads.push_back(ele.GetPayload());
+			ids.push_back(id);
+		}
+		void Reserve(const int& n) {
+			rects.reserve((n + 3) / 4);
+			payloads.reserve(n);
+			ids.reserve(n);
+		}
+		void Pop() {
+			payloads.pop_back();
+			ids.pop_back();
+			if ((ids.size() & 3) == 0) rects.pop_back();
+		}
+	};
+	typedef QNodeElesT<void*, float> QNodeEles;
+	struct QUADTREE_API_DLL QNodeEleHandle {
+		// index of the element's bookkeeping in eleInfos
+		int idx;
+		// generation of the element's slot when it was inserted,
+		// a handle becomes invalid once its element is erased
+		unsigned int gen;
+		QNodeEleHandle(int idx = -1, unsigned int gen = 0)
+			: idx(idx), gen(gen) {}
+		bool operator==(const QNodeEleHandle& rhs) const {
+			return rhs.idx == idx && rhs.gen == gen;
+		}
+	};
+	// 8 bytes, node and gen share a word
+	struct QUADTREE_API_DLL QNodeEleInfo {
+		// a tree has fewer nodes than NO_NODE, see canInsert4Nodes
+		enum { NO_NODE = (1 << 24) - 1 };
+		// index of the leaf which holds this element, NO_NODE if the element is erased
+		unsigned int node : 24;
+		// increased every time the element is erased, a handle 256 erases old may match again
+		unsigned int gen : 8;
+		// index of the element in the leaf's nodeEles,
+		// or the next free info if the element is erased
+		int slot;
+		QNodeEleInfo() : node(NO_NODE), gen(0), slot(-1) {}
 	};
 
-	inline QTPoint GetRectCenter(const QTRect& r) {
+	template<typename Coord>
+	inline QTPointT<Coord> GetRectCenter(const QTRectT<Coord>& r) {
 		return { (r.r - r.l) / 2 + r.l, (r.b - r.t) / 2 + r.t };
 	}
 
-	inline bool IsRectsIntersect(const QTRect& lhs, const QTRect& rhs) {
+	template<typename Coord>
+	inline typename QTReal<Coord>::type GetRectArea(const QTRectT<Coord>& r) {
+		return static_cast<typename QTReal<Coord>::type>(r.r - r.l) * (r.b - r.t);
+	}
+
+	template<typename Coord>
+	inline bool IsRectsIntersect(const QTRectT<Coord>& lhs, const QTRectT<Coord>& rhs) {
 		return !(rhs.l > lhs.r || rhs.r < lhs.l || rhs.t > lhs.b || rhs.b < lhs.t);
 	}
 
-	inline QTRect& UnionRect(QTRect& inout, const QTRect& in) {
+	template<typename Coord>
+	inline QTRectT<Coord>& UnionRect(QTRectT<Coord>& inout, const QTRectT<Coord>& in) {
 		inout.l = in.l < inout.l ? in.l : inout.l;
 		inout.r = in.r > inout.r ? in.r : inout.r;
 		inout.t = in.t < inout.t ? in.t : inout.t;
@@ -82,46 +231,2149 @@ namespace LQT { // loose quad tree
 		return inout;
 	}
 
-	inline bool IsPointInsideRect(const QTRect& rect, const QTPoint& point) {
+	template<typename Coord>
+	inline bool IsPointInsideRect(const QTRectT<Coord>& rect, const QTPointT<Coord>& point) {
 		return !(rect.l > point.x || rect.r < point.x || rect.t > point.y || rect.b < point.y);
 	}
 
-	template class QUADTREE_API_DLL FreeList<QNodeEle>;
-	template class QUADTREE_API_DLL FreeList<QNodeElePtr>;
+	// squared distance from the point to the nearest point of rect, 0 if the point is inside
+	template<typename Coord>
+	inline typename QTReal<Coord>::type GetRectPointDistanceSq(const QTRectT<Coord>& rect, const QTPointT<Coord>& point) {
+		typedef typename QTReal<Coord>::type Real;
+		const Real dx = point.x < rect.l ? Real(rect.l - point.x) : (point.x > rect.r ? Real(point.x - rect.r) : 0);
+		const Real dy = point.y < rect.t ? Real(rect.t - point.y) : (point.y > rect.b ? Real(point.y - rect.b) : 0);
+		return dx * dx + dy * dy;
+	}
+
+	// t where the ray origin + t * dir enters rect, 0 if origin is inside.
+	// return false if the ray misses rect for t in [0, maxT]
+	template<typename Coord>
+	inline bool GetRayRectEntry(const QTPointT<Coord>& origin, const QTPointT<Coord>& dir,
+		const typename QTReal<Coord>::type& maxT, const QTRectT<Coord>& rect, typename QTReal<Coord>::type& t) {
+		typedef typename QTReal<Coord>::type Real;
+		Real tmin = 0, tmax = maxT;
+		// clip by the slab of each axis, a ray parallel to the slab must start inside it
+		if (dir.x != 0) {
+			Real t0 = (Real(rect.l) - origin.x) / dir.x, t1 = (Real(rect.r) - origin.x) / dir.x;
+			if (t0 > t1) std::swap(t0, t1);
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+		}
+		else if (origin.x < rect.l || origin.x > rect.r) return false;
+		if (dir.y != 0) {
+			Real t0 = (Real(rect.t) - origin.y) / dir.y, t1 = (Real(rect.b) - origin.y) / dir.y;
+			if (t0 > t1) std::swap(t0, t1);
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+		}
+		else if (origin.y < rect.t || origin.y > rect.b) return false;
+		t = tmin;
+		return tmin <= tmax;
+	}
+
+	// hit tests used by the templated queries, shape first and node or element rect second
+	template<typename Coord>
+	inline bool IsShapeIntersectRect(const QTRectT<Coord>& shape, const QTRectT<Coord>& rect) {
+		return IsRectsIntersect(shape, rect);
+	}
+
+	template<typename Coord>
+	inline bool IsShapeIntersectRect(const QTPointT<Coord>& shape, const QTRectT<Coord>& rect) {
+		return IsPointInsideRect(rect, shape);
+	}
+
+	template<typename Coord>
+	struct QTCircleT {
+		QTPointT<Coord> center;
+		typename QTReal<Coord>::type radius;
+		QTCircleT(const QTPointT<Coord>& center = {}, typename QTReal<Coord>::type radius = 0)
+			: center(center), radius(radius) {}
+	};
+	// convex polygon, such as the view frustum of a camera. the points may be in either winding
+	template<typename Coord>
+	struct QTConvexPolygonT {
+		typedef typename QTReal<Coord>::type Real;
+		std::vector<QTPointT<Coord>> points;
+		// outward normal of edge points[i] ~ points[i + 1] and the largest projection of the polygon on it
+		std::vector<QTPointT<Real>> normals;
+		std::vector<Real> extents;
+		QTRectT<Coord> bounds;
+		QTConvexPolygonT(const QTPointT<Coord>* first, const QTPointT<Coord>* last)
+			: points(first, last) {
+			const int n = static_cast<int>(points.size());
+			if (n == 0) return;
+			bounds = { points[0].x, points[0].y, points[0].x, points[0].y };
+			Real area = 0;
+			for (int i = 0; i < n; ++i) {
+				const QTPointT<Real> a(points[i].x, points[i].y);
+				const QTPointT<Real> b(points[(i + 1) % n].x, points[(i + 1) % n].y);
+				UnionRect(bounds, QTRectT<Coord>(points[i].x, points[i].y, points[i].x, points[i].y));
+				area += a.x * b.y - b.x * a.y;
+			}
+			for (int i = 0; i < n; ++i) {
+				const QTPointT<Real> a(points[i].x, points[i].y);
+				const QTPointT<Real> b(points[(i + 1) % n].x, points[(i + 1) % n].y);
+				const QTPointT<Real> normal = area >= 0 ? QTPointT<Real>(b.y - a.y, a.x - b.x) : QTPointT<Real>(a.y - b.y, b.x - a.x);
+				normals.push_back(normal);
+				extents.push_back(normal.x * a.x + normal.y * a.y);
+			}
+		}
+	};
+	// box of size 2 * halfSize around center, rotated by angle in radians
+	template<typename Coord>
+	struct QTOBBT {
+		typedef typename QTReal<Coord>::type Real;
+		QTPointT<Coord> center;
+		QTPointT<Coord> halfSize;
+		// the box's x axis, its y axis is (-axis.y, axis.x)
+		QTPointT<Real> axis;
+		QTOBBT(const QTPointT<Coord>& center = {}, const QTPointT<Coord>& halfSize = {}, Real angle = 0)
+			: center(center), halfSize(halfSize), axis(std::cos(angle), std::sin(angle)) {}
+	};
+	typedef QTCircleT<float> QTCircle;
+	typedef QTConvexPolygonT<float> QTConvexPolygon;
+	typedef QTOBBT<float> QTOBB;
+
+	template<typename Coord>
+	inline bool IsShapeIntersectRect(const QTCircleT<Coord>& shape, const QTRectT<Coord>& rect) {
+		return GetRectPointDistanceSq(rect, shape.center) <= shape.radius * shape.radius;
+	}
+
+	template<typename Coord>
+	inline bool IsShapeIntersectRect(const QTConvexPolygonT<Coord>& shape, const QTRectT<Coord>& rect) {
+		typedef typename QTReal<Coord>::type Real;
+		// separating axis test, the axes are the rect's and the normals of the polygon's edges
+		if (shape.points.empty() || !IsRectsIntersect(shape.bounds, rect)) return false;
+		for (std::size_t i = 0; i < shape.normals.size(); ++i) {
+			const QTPointT<Real>& n = shape.normals[i];
+			// the rect's corner with the smallest projection
+			const Real nearest = n.x * (n.x > 0 ? rect.l : rect.r) + n.y * (n.y > 0 ? rect.t : rect.b);
+			if (nearest > shape.extents[i]) return false;
+		}
+		return true;
+	}
+
+	template<typename Coord>
+	inline bool IsShapeIntersectRect(const QTOBBT<Coord>& shape, const QTRectT<Coord>& rect) {
+		typedef typename QTReal<Coord>::type Real;
+		// separating axis test on the axes of the rect and of the box
+		const Real c = std::fabs(shape.axis.x), s = std::fabs(shape.axis.y);
+		const QTPointT<Real> rh((Real(rect.r) - rect.l) / 2, (Real(rect.b) - rect.t) / 2);
+		const QTPointT<Real> d(Real(rect.l) + rh.x - shape.center.x, Real(rect.t) + rh.y - shape.center.y);
+		if (std::fabs(d.x) > c * shape.halfSize.x + s * shape.halfSize.y + rh.x) return false;
+		if (std::fabs(d.y) > s * shape.halfSize.x + c * shape.halfSize.y + rh.y) return false;
+		if (std::fabs(d.x * shape.axis.x + d.y * shape.axis.y) > shape.halfSize.x + c * rh.x + s * rh.y) return false;
+		if (std::fabs(d.y * shape.axis.x - d.x * shape.axis.y) > shape.halfSize.y + s * rh.x + c * rh.y) return false;
+		return true;
+	}
+
+	// bit i of the mask is set if the shape intersect rects.Get(i)
+	template<typename S, typename Coord>
+	inline int GetShapeIntersectMask(const S& shape, const QTRect4T<Coord>& rects) {
+		int mask = 0;
+		for (int i = 0; i < 4; ++i)
+			if (IsShapeIntersectRect(shape, rects.Get(i))) mask |= 1 << i;
+		return mask;
+	}
+
+	inline int GetShapeIntersectMask(const QTRect& shape, const QTRect4& rects) {
+#ifdef QUADTREE_USE_SSE
+		// same test as IsRectsIntersect, a lane misses if any of the four compares is true
+		__m128 miss = _mm_cmpgt_ps(_mm_loadu_ps(rects.l), _mm_set1_ps(shape.r));
+		miss = _mm_or_ps(miss, _mm_cmplt_ps(_mm_loadu_ps(rects.r), _mm_set1_ps(shape.l)));
+		miss = _mm_or_ps(miss, _mm_cmpgt_ps(_mm_loadu_ps(rects.t), _mm_set1_ps(shape.b)));
+		miss = _mm_or_ps(miss, _mm_cmplt_ps(_mm_loadu_ps(rects.b), _mm_set1_ps(shape.t)));
+		return ~_mm_movemask_ps(miss) & 0xF;
+#else
+		int mask = 0;
+		for (int i = 0; i < 4; ++i)
+			if (IsRectsIntersect(shape, rects.Get(i))) mask |= 1 << i;
+		return mask;
+#endif
+	}
+
+	inline int GetShapeIntersectMask(const QTPoint& shape, const QTRect4& rects) {
+		return GetShapeIntersectMask(QTRect(shape.x, shape.y, shape.x, shape.y), rects);
+	}
+
+	inline int GetShapeIntersectMask(const QTCircle& shape, const QTRect4& rects) {
+#ifdef QUADTREE_USE_SSE
+		// same test as GetRectPointDistanceSq, the distance of an axis is 0 if the center is inside the slab
+		const __m128 cx = _mm_set1_ps(shape.center.x), cy = _mm_set1_ps(shape.center.y);
+		const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(rects.l), cx),
+			_mm_sub_ps(cx, _mm_loadu_ps(rects.r))), _mm_setzero_ps());
+		const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(rects.t), cy),
+			_mm_sub_ps(cy, _mm_loadu_ps(rects.b))), _mm_setzero_ps());
+		const __m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		return _mm_movemask_ps(_mm_cmple_ps(d, _mm_set1_ps(shape.radius * shape.radius)));
+#else
+		int mask = 0;
+		for (int i = 0; i < 4; ++i)
+			if (IsShapeIntersectRect(shape, rects.Get(i))) mask |= 1 << i;
+		return mask;
+#endif
+	}
+
+	// deepest tree, root included. the morton codes of Build hold two bits for each of the 32 levels below the root
+	const int QT_MAX_DEPTH = 33;
+
+	// header of a snapshot written by BasicQuadTree::Save. the snapshot is made of indices only,
+	// so it can be mapped at any address and read in place by BasicQuadTreeView.
+	// numbers are in the byte order of the machine which saved it, the sections are 8 bytes aligned
+	struct QUADTREE_API_DLL QTSnapshotHeader {
+		enum { VERSION = 1 };
+		char magic[4]; // "LQTS"
+		unsigned int version;
+		// sizeof(Coord) and whether Coord is a floating type
+		unsigned int coordSize;
+		unsigned int coordFloat;
+		int maxDepth;
+		int maxElePerLeaf;
+		int adaptive;
+		int autoGrow;
+		int grownLevels;
+		int freeNode;
+		int nodeCount;
+		int eleCount;
+		// blocks of four element rects, every node's elements start a new block
+		int blockCount;
+		int reserved;
+		double looseFactor;
+		// byte offsets of the sections from the start of the snapshot:
+		// root is rootRect and rootCenter, halfSizes has maxDepth + 1 points,
+		// nodes has nodeCount QTSnapshotNodeT and childRects (nodeCount - 1) / 4 QTRect4T,
+		// eleBegin and blockBegin have nodeCount + 1 ints, the elements of node i are
+		// eleBegin[i] ~ eleBegin[i + 1] - 1 and their rects start at block blockBegin[i],
+		// rects has blockCount QTRect4T and ids has eleCount ids
+		unsigned long long root, halfSizes, nodes, childRects, eleBegin, blockBegin, rects, ids;
+	};
+	// node of a snapshot, the fields of QNodeT without padding
+	template<typename Coord>
+	struct QTSnapshotNodeT {
+		QTRectT<Coord> aabbRect;
+		int first_child;
+		int count;
+		int dirty;
+		int reserved;
+	};
+
+	// whether the links of the snapshot which starts with header stay inside it, its sections must be.
+	// every node's elements and blocks must be its part of the sections, a leaf's count must be its number
+	// of elements, branches must be above maxDepth and every group of 4 nodes must be the children
+	// of one branch or in the free list once, so the tree has no cycle
+	template<typename Coord>
+	inline bool IsSnapshotLinked(const QTSnapshotHeader* header) {
+		typedef QTSnapshotNodeT<Coord> SnapshotNode;
+		const char* base = reinterpret_cast<const char*>(header);
+		const int nodeCount = header->nodeCount;
+		const SnapshotNode* nodes = reinterpret_cast<const SnapshotNode*>(base + header->nodes);
+		const int* eleBegin = reinterpret_cast<const int*>(base + header->eleBegin);
+		const int* blockBegin = reinterpret_cast<const int*>(base + header->blockBegin);
+		if (eleBegin[0] != 0 || blockBegin[0] != 0 || eleBegin[nodeCount] != header->eleCount ||
+			blockBegin[nodeCount] != header->blockCount || header->grownLevels < 0 || header->grownLevels >= header->maxDepth ||
+			header->maxElePerLeaf < 0) return false;
+		for (int i = 0; i < nodeCount; ++i) {
+			const int count = eleBegin[i + 1] - eleBegin[i];
+			if (count < 0 || blockBegin[i + 1] - blockBegin[i] != (count + 3) / 4) return false;
+		}
+		// first node of a group, the group is marked as it's reached
+		std::vector<char> reached((nodeCount - 1) / 4, 0);
+		const auto reach = [&](int first) {
+			if (first < 1 || first > nodeCount - 4 || (first - 1) % 4 != 0 || reached[(first - 1) / 4]) return false;
+			reached[(first - 1) / 4] = 1;
+			return true;
+		};
+		// (node, depth)
+		std::vector<std::pair<int, int>> toProcess(1, std::make_pair(0, 1));
+		while (!toProcess.empty()) {
+			const int idx = toProcess.back().first, depth = toProcess.back().second;
+			toProcess.pop_back();
+			const SnapshotNode& node = nodes[idx];
+			if (node.count == -1) { // it's branch
+				if (depth >= header->maxDepth || !reach(node.first_child)) return false;
+				for (int i = 0; i < 4; ++i)
+					toProcess.push_back(std::make_pair(node.first_child + i, depth + 1));
+			}
+			else if (node.count != eleBegin[idx + 1] - eleBegin[idx]) return false;
+		}
+		for (int i = header->freeNode; i != -1; i = nodes[i].first_child)
+			if (!reach(i)) return false;
+		return true;
+	}
+
+	// the header of the snapshot data ~ data + size if it's a valid snapshot of Coord, or null.
+	// its links are checked too, so a tree or a view can read it as it is
+	template<typename Coord>
+	inline const QTSnapshotHeader* GetSnapshotHeader(const void* data, std::size_t size) {
+		const QTSnapshotHeader* header = static_cast<const QTSnapshotHeader*>(data);
+		if (!data || reinterpret_cast<std::uintptr_t>(data) % 8 != 0 || size < sizeof(QTSnapshotHeader) ||
+			std::memcmp(header->magic, "LQTS", 4) != 0 || header->version != QTSnapshotHeader::VERSION ||
+			header->coordSize != sizeof(Coord) || header->coordFloat != (static_cast<Coord>(0.5) != 0) ||
+			header->nodeCount < 1 || (header->nodeCount - 1) % 4 != 0 || header->eleCount < 0 ||
+			header->blockCount < 0 || header->maxDepth < 1 || header->maxDepth > QT_MAX_DEPTH) return nullptr;
+		// every section must be aligned and inside the snapshot
+		const unsigned long long n = header->nodeCount;
+		const unsigned long long sections[][2] = {
+			{ header->root, sizeof(QTRectT<Coord>) + sizeof(QTPointT<Coord>) },
+			{ header->halfSizes, sizeof(QTPointT<Coord>) * (header->maxDepth + 1ull) },
+			{ header->nodes, sizeof(QTSnapshotNodeT<Coord>) * n },
+			{ header->childRects, sizeof(QTRect4T<Coord>) * ((n - 1) / 4) },
+			{ header->eleBegin, sizeof(int) * (n + 1) },
+			{ header->blockBegin, sizeof(int) * (n + 1) },
+			{ header->rects, sizeof(QTRect4T<Coord>) * static_cast<unsigned long long>(header->blockCount) },
+			{ header->ids, sizeof(unsigned long long) * static_cast<unsigned long long>(header->eleCount) } };
+		for (const auto& sec : sections)
+			if (sec[0] % 8 != 0 || sec[0] > size || sec[1] > size - sec[0]) return nullptr;
+		return IsSnapshotLinked<Coord>(header) ? header : nullptr;
+	}
+
+	template<typename Payload, typename Coord = float, int MaxDepth = 0, int MaxElePerLeaf = 0,
+		typename Alloc = std::allocator<char>>
+	class BasicQuadTree;
+	template<typename Coord>
+	class BasicQuadTreeView;
+
+	// shape of a tree, see BasicQuadTree::GetStats
+	struct QUADTREE_API_DLL QTStats {
+		// reachable nodes, root included
+		int nodeCount;
+		int leafCount;
+		int elementCount;
+		// elements kept by branches, only the loose mode has some
+		int branchElementCount;
+		// depth of the deepest leaf and the average depth of the leaves, root is at depth 1
+		int maxDepth;
+		double averageDepth;
+		// leafHistogram[i] is the number of leaves with i elements,
+		// the last one counts the leaves with more than maxElePerLeaf
+		std::vector<int> leafHistogram;
+		// leaves at maxDepth with more than maxElePerLeaf elements, they can't split any more
+		int overfullLeafCount;
+		int largestLeaf;
+		// slots of nodes and element infos, and how many of them are in the free lists
+		int nodeSlots;
+		int freeNodeSlots;
+		int eleInfoSlots;
+		int freeEleInfoSlots;
+	};
+
+	// what the queries which used a scratch did, only with QUADTREE_QUERY_STATS
+	struct QUADTREE_API_DLL QTQueryCounters {
+		long long queries;
+		long long nodesVisited;
+		// elements whose rect is tested against the query
+		long long elementTests;
+		long long hits;
+		QTQueryCounters() : queries(0), nodesVisited(0), elementTests(0), hits(0) {}
+	};
+
+	// traversal stack of the visitor queries, reuse it to avoid allocating on every query
+	class QUADTREE_API_DLL QueryScratch {
+		template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+		friend class BasicQuadTree;
+		template<typename Coord>
+		friend class BasicQuadTreeView;
+		std::vector<int> toProcess;
+		// (distance, node) heap of QueryNearest and Raycast
+		std::vector<std::pair<double, int>> nodeHeap;
+#ifdef QUADTREE_QUERY_STATS
+	public:
+		// the library and its users must agree on QUADTREE_QUERY_STATS, it changes the layout
+		QTQueryCounters counters;
+#endif
+	};
+
+// count the work of a query in its scratch, it's nothing without QUADTREE_QUERY_STATS
+#ifdef QUADTREE_QUERY_STATS
+#define QUADTREE_COUNT(scratch, counter, n) ((scratch).counters.counter += (n))
+#else
+#define QUADTREE_COUNT(scratch, counter, n) ((void)0)
+#endif
+
+	// hits of a batch of queries in one array, query i hit hits[offsets[i]] ~ hits[offsets[i + 1] - 1]
+	template<typename Element>
+	struct BasicQueryBatchResult {
+		std::vector<int> offsets;
+		std::vector<Element> hits;
+	};
+	typedef BasicQueryBatchResult<QNodeEle> QueryBatchResult;
+
+	// scratch used by the visitor queries when the caller doesn't pass one
+	inline QueryScratch& GetThreadQueryScratch() {
+		static thread_local QueryScratch scratch;
+		return scratch;
+	}
 
-	class QUADTREE_API_DLL QuadTree {
+	// loose quad tree of elements which carry a Payload by value, such as an entity id or a pointer.
+	// Coord may be float, double or int, distances are double for double coordinates and float for others.
+	// MaxDepth and MaxElePerLeaf fix the limits at compile time when they are not 0,
+	// then the arguments of the constructors are ignored and the descent loops have a constant bound.
+	// every array of the tree, and the temporary ones of Build, Save and QueryBatch, allocates with Alloc
+	// rebound to its type, a copy of the allocator given to the constructor. the parallel Build and QueryBatch
+	// allocate on the threads of the pool
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	class BasicQuadTree {
+		static_assert(MaxDepth <= QT_MAX_DEPTH, "MaxDepth is beyond QT_MAX_DEPTH");
 	public:
-		QuadTree(QTRect rect, int maxDepth = 3,
-			int maxElePerLeaf = 4);
-		void Insert(const QNodeEle& ele);
-		bool Erase(const QNodeEle& ele);
-		bool Query(const QTRect& rect, std::list<QNodeEle>& retList);
-		bool Query(const QTPoint& point, std::list<QNodeEle>& retList);
+		typedef QTRectT<Coord> Rect;
+		typedef QTPointT<Coord> Point;
+		typedef QTElement<Payload, Coord> Element;
+		typedef typename QTReal<Coord>::type Real;
+		typedef BasicQueryBatchResult<Element> BatchResult;
+		// looseFactor >= 1 turns on the loose mode (2 is the usual choice): the cell of a node is looseFactor
+		// times its size around its center, an element is kept by the deepest node whose cell contains it, even a branch,
+		// and the bounds of nodes are never recomputed. with 0 every element is kept by the leaf
+		// of its center and the bounds are the exact aabbs of the elements.
+		// with autoGrow an element out of the root doubles it, the old root becomes one of the
+		// four children of the new one and maxDepth grows by one, so the leaves keep their size.
+		// Cleanup shrinks it back. it needs a runtime maxDepth and root centers which are exact in Coord,
+		// such as integer bounds, the tree stops growing as soon as a center can't be exact.
+		// maxDepth 0 makes the depth adaptive: a full leaf splits as long as it keeps an element
+		// no larger than a child, down to 24 levels where float can't tell the cells apart.
+		// a runtime maxDepth above QT_MAX_DEPTH is clamped to it
+		BasicQuadTree(Rect rect, int maxDepth = 3,
+			int maxElePerLeaf = 4, Real looseFactor = 0, bool autoGrow = false, const Alloc& alloc = Alloc());
+		// build the tree from [first, last) at once, see Build. the other arguments are the ones of the constructor above
+		BasicQuadTree(Rect rect, const Element* first, const Element* last,
+			int maxDepth = 3, int maxElePerLeaf = 4, QNodeEleHandle* handles = nullptr,
+			Real looseFactor = 0, bool autoGrow = false, const Alloc& alloc = Alloc());
+		// replace all elements with [first, last). without the loose mode the result is the same as inserting
+		// them one by one, but elements are sorted by the morton code of their center and the nodes are created in one pass.
+		// handles[i] receives the handle of first[i] if handles is not null
+		void Build(const Element* first, const Element* last, QNodeEleHandle* handles = nullptr);
+		// same as Build, but the work is shared by the threads of pool. the tree is split by quadrants
+		// until the parts are small enough, then each part is built alone and moved into the tree
+		void Build(const Element* first, const Element* last, QTThreadPool& pool,
+			QNodeEleHandle* handles = nullptr);
+		// return an invalid handle if the tree has a hard capacity and it's full, see Reserve
+		QNodeEleHandle Insert(const Element& ele);
+		bool Erase(const Element& ele);
+		// erase the element without searching it in the tree
+		bool Erase(const QNodeEleHandle& handle);
+		bool IsValid(const QNodeEleHandle& handle) const;
+		// move the element to rect, it stays in its leaf if the new center is still inside it
+		bool Move(const QNodeEleHandle& handle, const Rect& rect);
+		bool Query(const Rect& rect, std::list<Element>& retList) const;
+		bool Query(const Point& point, std::list<Element>& retList) const;
+		// onHit(const Element&) is called for every hit, return false from it to stop the query.
+		// the tree must not be modified inside onHit
+		template<typename F>
+		bool Query(const Rect& rect, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+		template<typename F>
+		bool Query(const Point& point, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+		// the same for QTCircleT, QTConvexPolygonT, QTOBBT or any shape S with
+		// IsShapeIntersectRect(const S&, const Rect&), nodes are pruned by the exact test of the shape
+		template<typename S, typename F>
+		bool Query(const S& shape, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+		// onHit(const Element&, Real t) is called for every element hit by the ray origin + t * dir
+		// with t in [0, maxT], in the order of t where the ray enters them. return false from it to stop,
+		// so returning false at once gives the first hit. dir needn't be normalized,
+		// the segment from a to b is origin = a, dir = b - a and maxT = 1
+		template<typename F>
+		bool Raycast(const Point& origin, const Point& dir, Real maxT, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+		// the k elements nearest to point within maxDist, as (distance, element) nearest first.
+		// nodes are visited by the distance to their aabb, so far subtrees are never visited.
+		// return the number of elements found, a negative maxDist finds none
+		int QueryNearest(const Point& point, int k, Real maxDist,
+			std::vector<std::pair<Real, Element>>& out, QueryScratch& scratch = GetThreadQueryScratch()) const;
+		// the nearest element within maxDist, it doesn't allocate. return false if there is none
+		bool QueryNearest(const Point& point, Real maxDist, Element& nearest, Real* dist = nullptr) const;
+		// run the queries [first, last) on the threads of pool, the tree must not be modified meanwhile.
+		// with mortonOrder the queries are run in the morton order of their center, so close queries
+		// share the nodes in cache. the order of result is the order of the queries anyway
+		void QueryBatch(const Rect* first, const Rect* last, BatchResult& result,
+			QTThreadPool& pool, bool mortonOrder = true) const;
+		void QueryBatch(const Point* first, const Point* last, BatchResult& result,
+			QTThreadPool& pool, bool mortonOrder = true) const;
+		// onPair(const Element&, const Element&) is called once for every two intersecting elements,
+		// return false from it to stop. the tree must not be modified inside onPair
+		template<typename F>
+		void ForEachIntersectingPair(F&& onPair) const;
+		// onPair(const Element& fromLhs, const Element& fromRhs) is called once for every two
+		// intersecting elements of different trees, return false from it to stop
+		template<typename F>
+		static void Join(const BasicQuadTree& lhs, const BasicQuadTree& rhs, F&& onPair);
 		void Cleanup(); // Cleanup empty branch and update branches aabbRect
+		// same as Cleanup but only for the dirty nodes, and it stops after refreshing maxNodes nodes.
+		// call it again to go on, return true if no dirty node is left
+		bool Cleanup(int maxNodes);
+		// make room for nodeCount nodes and eleCount elements, so the arrays of nodes and element infos
+		// don't grow until then. with hardCapacity they never grow: a leaf which would split
+		// beyond nodeCount keeps its elements, root doesn't grow and Insert fails beyond eleCount.
+		// Build keeps the nodes in the capacity but takes every element it's given, Load takes the snapshot as it is.
+		// the elements of a leaf are still allocated by the leaf when it needs them
+		void Reserve(int nodeCount, int eleCount, bool hardCapacity = false);
+		// renumber the nodes in depth first order, so a query walks them forward in memory,
+		// and release the free nodes and the unused capacity of the leaves. handles stay valid,
+		// the free element infos are reused from the lowest one. it's a full pass over the tree
+		// with a second copy of its nodes for a while, call it after Cleanup when there is time
+		void Compact();
+		// walk the tree and count its nodes, elements and free slots
+		QTStats GetStats() const;
+		// write the tree to out as a snapshot, see QTSnapshotHeader. a payload is saved as
+		// the id idOf(const Payload&) returns, an unsigned long long. return false if out fails
+		template<typename F>
+		bool Save(std::ostream& out, F&& idOf) const;
+		// replace the tree with the snapshot data ~ data + size, data must be 8 bytes aligned.
+		// the nodes are copied as they are, nothing is inserted, and payloadOf(unsigned long long id)
+		// gives the payload of an element. handles of the old elements become invalid.
+		// handles[k] receives the handle of the element of the k-th call to payloadOf if handles is not null.
+		// return false and leave the tree as it was if data isn't a snapshot of this kind of tree
+		template<typename F>
+		bool Load(const void* data, std::size_t size, F&& payloadOf, QNodeEleHandle* handles = nullptr);
 	private:
-		void insert(const QTPoint& cp, int cnIdx,
-			const QTPoint& xcp, int xndIdx,
-			int depth);
-		void insert2(const QTPoint& cp, int cnIdx,
-			const QTRect& xcp, int xndIdx = 0, int depth = 1);
+		// insert the element to the node which should keep it, eleIdx is its info
+		void insert(const Element& ele, const int& eleIdx);
+		// turn the leaf to a branch and move its elements to the new children,
+		// in the loose mode the elements which don't fit a child stay. cp is the leaf's center
+		void split(const int& idx, const Point& cp, const int& depth);
+		// whether a full leaf at cp and depth gains from a split. the elements must not all go to the same place,
+		// or coincident ones would make a chain down to maxDepth. in the loose mode an element
+		// must fit a child, in the adaptive mode an element must be no larger than a child
+		bool canSplit(const int& idx, const Point& cp, const int& depth) const;
+		// move the elements of the four leaves under branch idx to it, and it becomes a leaf
+		void mergeChildren(const int& idx);
+		// path of the leaf which include xcp at maxDepth, two bits per level and root's choice is the highest.
+		// it holds 32 levels, so maxDepth is at most QT_MAX_DEPTH
+		unsigned long long mortonCode(const Point& xcp) const;
+		// invalidate every handle, take infos [0, n) for the new elements and reset the nodes
+		void resetForBuild(const int& n);
+		// create the subtree idx from [first, last), which are (morton code, index in eles) sorted by code.
+		// eleInfos is not touched, see linkEles
+		// cp is the center of node idx, the range is reordered in the loose mode
+		void build(const int& idx, const Element* eles, std::pair<unsigned long long, int>* first,
+			std::pair<unsigned long long, int>* last, const int& depth, const Point& cp);
+		// point the infos of node idx's elements to their slots
+		void linkEles(const int& idx);
+		// set the aabb of branch idx to the union of its non-empty children
+		void unionChildren(const int& idx);
+		// move cp from a node's center to the center of its child which include xcp,
+		// offset is the half size of the child. return the child's number
+		static inline int descend(const Point& xcp, Point& cp, const Point& offset);
+		// center of child i of the node at cp, the child is at depth
+		inline Point childCenter(const Point& cp, const int& i, const int& depth) const;
+		// loose cell of the node at cp and depth
+		inline Rect looseCell(const Point& cp, const int& depth) const;
+		// whether an element with rect should go down from the node at cp and depth to a child,
+		// it's always true without the loose mode
+		inline bool fitsChild(const Rect& rect, const Point& cp, const int& depth) const;
+		// whether rect is no larger than a child of a node at depth, it's always true without
+		// the adaptive mode. larger elements are found by every query of the leaf anyway
+		inline bool fitsChildSize(const Rect& rect, const int& depth) const;
+		// set the aabb of root to its loose cell and the elements it keeps
+		void looseRootAABB();
+		// with autoGrow, double root until it includes xcp
+		void growFor(const Point& xcp);
+		// double root toward xcp, return false if it can't grow
+		bool growRoot(const Point& xcp);
+		// while root has a single non-empty child, the child becomes root.
+		// an empty tree goes back to rootRect
+		void shrinkRoot();
+		// set root to rootRect, the tree must be empty
+		void resetRoot();
 		void insert4Nodes(int&); // insert 4 new nodes;
+		// whether insert4Nodes stays in the hard capacity
+		inline bool canInsert4Nodes() const;
 		//int insert4Nodes();
 		// erase childs of nodes's element which index is idx
 		// and reset its node's property to default value
 		void eraseNodes(const int& idx);
-		// to find out the leaf which include cp
-		void queryLeaf(const QTPoint& cp, int& nodeIdx);
-		inline void updateAABBSinceInsert(const int& xndIdx, const int& cnIdx);
-		QTRect cleanupHelper(int idx, int& child);
-		void cleanupHelper();
+		// maxDepth and maxElePerLeaf, or the template arguments if they are given
+		inline int depthLimit() const;
+		inline int leafCapacity() const;
+		// to find out the node which keeps an element with rect
+		void queryLeaf(const Rect& rect, int& nodeIdx);
+		// union rect to the AABB of every node on the path to the leaf which include cp
+		void widenAABB(const Point& cp, const Rect& rect);
+		// mark every node on the path to the leaf which include cp dirty
+		void markDirty(const Point& cp);
+		// append the element to the node and update eleInfos[eleIdx]
+		inline void pushEle(const int& idx, const Element& ele, const int& eleIdx);
+		// remove the slot-th element of the node, the last element takes its slot
+		void removeEle(const int& idx, const int& slot);
+		// put the info to the free list and invalidate its handles
+		void freeEle(const int& eleIdx);
+		inline void updateAABBSinceInsert(const Rect& rect, const int& cnIdx);
+		// copy nodes[idx].aabbRect to its lane in childRects
+		inline void syncAABB(const int& idx);
+		// query the subtree root
+		template<typename S, typename F>
+		bool query(const S& shape, F& onHit, QueryScratch& scratch, int root = 0) const;
+		// depth first search of the nearest element in subtree idx, nearer children first.
+		// bestSq is the squared distance of best
+		void nearest(const int& idx, const Point& point, Real& bestSq, Element& best, bool& found) const;
+		// the point where a batch query is sorted by
+		static Point getShapeCenter(const Rect& rect);
+		static Point getShapeCenter(const Point& point);
+		template<typename S>
+		void queryBatch(const S* first, const S* last, BatchResult& result,
+			QTThreadPool& pool, bool mortonOrder) const;
+		// call onEle(i) for every element i >= from of node idx which intersect the shape,
+		// return false as soon as onEle returns false
+		template<typename S, typename F>
+		bool scanEles(int idx, const S& shape, int from, F&& onEle) const;
+		// report the intersecting pairs inside the subtree idx
+		template<typename F>
+		bool selfPairs(int idx, F& onPair) const;
+		// report the intersecting pairs between subtree lIdx of lhs and subtree rIdx of rhs
+		template<typename F>
+		static bool crossPairs(const BasicQuadTree& lhs, int lIdx,
+			const BasicQuadTree& rhs, int rIdx, F& onPair);
+		// report the intersecting pairs between the elements kept by node idx of src and subtree oIdx
+		// of other, the element of src is passed first to onPair if srcIsLhs
+		template<typename F>
+		static bool nodeElePairs(const BasicQuadTree& src, int idx,
+			const BasicQuadTree& other, int oIdx, bool srcIsLhs, F& onPair);
+		// copy the children of nodes[idx], which is newNodes[newIdx], and their subtrees to the new arrays
+		void compactHelper(const int& idx, const int& newIdx, QTVector<QNodeT<Coord>, Alloc>& newNodes,
+			QTVector<QNodeElesT<Payload, Coord, Alloc>, Alloc>& newEles, QTVector<QTRect4T<Coord>, Alloc>& newRects) const;
+		// copy of the elements of node idx with no unused capacity
+		QNodeElesT<Payload, Coord, Alloc> packEles(const int& idx) const;
+		// add subtree idx at depth to stats, averageDepth holds the sum of the depths until the end
+		void statsHelper(const int& idx, const int& depth, QTStats& stats) const;
+		Rect cleanupHelper(int idx, int& child);
+		// refresh the dirty nodes of subtree idx, children first. return false if budget runs out
+		bool cleanupDirty(const int& idx, int& budget);
 	private:
-		FreeList<QNodeElePtr> elePtrs;
-		FreeList<QNodeEle> eles;
-		std::vector<QNode> nodes;
+		typedef QNodeT<Coord> Node;
+		typedef QNodeElesT<Payload, Coord, Alloc> Eles;
+		typedef QTRect4T<Coord> Rect4;
+		Alloc alloc;
+		// bookkeeping of every element, handles point here
+		QTVector<QNodeEleInfo, Alloc> eleInfos;
+		// head of the free infos, linked by their slot
+		int free_ele;
+		QTVector<Node, Alloc> nodes;
+		// nodeEles[i] is the elements of nodes[i], a branch has none except in the loose mode
+		QTVector<Eles, Alloc> nodeEles;
+		// the aabbRects of nodes[4 * i + 1] ~ nodes[4 * i + 4] which are allocated together,
+		// so a branch can test all its children at once
+		QTVector<Rect4, Alloc> childRects;
 		int free_node;
+		// the hard capacity of nodes and eleInfos given to Reserve, 0 if they may grow
+		int nodeCapacity;
+		int eleCapacity;
 		int maxDepth;
+		// maxDepth was 0, the leaves split by their elements until maxDepth
+		bool adaptive;
 		int maxElePerLeaf;
-		QTRect rootRect;
+		// the rect given to the constructor, root may have grown from it
+		Rect rootRect;
+		Point rootCenter;
+		bool autoGrow;
+		// times root has doubled from rootRect
+		int grownLevels;
+		// halfSizes[depth] is the half size of the nodes at depth, root is at depth 1
+		QTVector<Point, Alloc> halfSizes;
+		// 0 if the tree isn't loose
+		Real looseFactor;
 	};
 
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const Rect& rect, F&& onHit, QueryScratch& scratch) const {
+		return query(rect, onHit, scratch);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const Point& point, F&& onHit, QueryScratch& scratch) const {
+		return query(point, onHit, scratch);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename S, typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const S& shape, F&& onHit, QueryScratch& scratch) const {
+		return query(shape, onHit, scratch);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Raycast(const Point& origin, const Point& dir, Real maxT, F&& onHit,
+		QueryScratch& scratch) const {
+		// a min heap by entry t of nodes, and of elements as -1 - their info,
+		// every node left enters later than the popped entry so hits come out front to back
+		std::vector<std::pair<double, int>>& heap = scratch.nodeHeap;
+		const std::size_t base = heap.size();
+		const auto greater = [](const std::pair<double, int>& a, const std::pair<double, int>& b) { return a.first > b.first; };
+		bool hit = false;
+		Real t;
+		QUADTREE_COUNT(scratch, queries, 1);
+		if (nodes[0].count != 0 && GetRayRectEntry(origin, dir, maxT, nodes[0].aabbRect, t))
+			heap.push_back({ t, 0 });
+		while (heap.size() > base) {
+			std::pop_heap(heap.begin() + base, heap.end(), greater);
+			const std::pair<double, int> top = heap.back();
+			heap.pop_back();
+			if (top.second < 0) { // it's element
+				const QNodeEleInfo& info = eleInfos[-1 - top.second];
+				hit = true;
+				QUADTREE_COUNT(scratch, hits, 1);
+				if (!onHit(nodeEles[info.node].Get(info.slot), static_cast<Real>(top.first))) {
+					heap.resize(base);
+					return hit;
+				}
+				continue;
+			}
+			const Node& node = nodes[top.second];
+			// elements of a leaf, or of a branch in the loose mode
+			const Eles& ne = nodeEles[top.second];
+			QUADTREE_COUNT(scratch, nodesVisited, 1);
+			QUADTREE_COUNT(scratch, elementTests, ne.ids.size());
+			for (int i = 0; i < static_cast<int>(ne.ids.size()); ++i) {
+				if (!GetRayRectEntry(origin, dir, maxT, ne.GetRect(i), t)) continue;
+				heap.push_back({ t, -1 - ne.ids[i] });
+				std::push_heap(heap.begin() + base, heap.end(), greater);
+			}
+			if (node.count == -1) { // it's branch
+				const Rect4& rects = childRects[(node.first_child - 1) >> 2];
+				for (int i = 0; i < 4; ++i) {
+					if (nodes[node.first_child + i].count == 0 ||
+						!GetRayRectEntry(origin, dir, maxT, rects.Get(i), t)) continue;
+					heap.push_back({ t, node.first_child + i });
+					std::push_heap(heap.begin() + base, heap.end(), greater);
+				}
+			}
+		}
+		return hit;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename S, typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::query(const S& shape, F& onHit, QueryScratch& scratch, int root) const {
+		// the stack may already be used by a query which calls this one from its onHit,
+		// so only the part above base belongs to this query
+		std::vector<int>& toProcess = scratch.toProcess;
+		const std::size_t base = toProcess.size();
+		bool hit = false;
+		// nodes on the stack are already tested, the first alone and others four at a time by their parent
+		QUADTREE_COUNT(scratch, queries, 1);
+		if (!IsShapeIntersectRect(shape, nodes[root].aabbRect)) return hit;
+		toProcess.push_back(root);
+		while (toProcess.size() > base) {
+			const int idx = toProcess.back();
+			const Node& node = nodes[idx];
+			toProcess.pop_back();
+			// elements of a leaf, or of a branch in the loose mode
+			const Eles& ne = nodeEles[idx];
+			QUADTREE_COUNT(scratch, nodesVisited, 1);
+			QUADTREE_COUNT(scratch, elementTests, ne.ids.size());
+			const bool goOn = scanEles(idx, shape, 0, [&](int i) {
+				hit = true;
+				QUADTREE_COUNT(scratch, hits, 1);
+				return static_cast<bool>(onHit(ne.Get(i)));
+			});
+			if (!goOn) {
+				toProcess.resize(base);
+				return hit;
+			}
+			if (node.count == -1) { // it's branch
+				const int mask = GetShapeIntersectMask(shape, childRects[(node.first_child - 1) >> 2]);
+				if (mask & 1) toProcess.push_back(node.first_child + 0);
+				if (mask & 2) toProcess.push_back(node.first_child + 1);
+				if (mask & 4) toProcess.push_back(node.first_child + 2);
+				if (mask & 8) toProcess.push_back(node.first_child + 3);
+			}
+		}
+		return hit;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename S, typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::scanEles(int idx, const S& shape, int from, F&& onEle) const {
+		const Eles& ne = nodeEles[idx];
+		const int count = static_cast<int>(ne.ids.size());
+		for (int blk = from >> 2; (blk << 2) < count; ++blk) {
+			int mask = GetShapeIntersectMask(shape, ne.rects[blk]);
+			// drop the lanes before from and after the last element
+			if ((blk << 2) < from) mask &= 0xF << (from & 3);
+			if (count - (blk << 2) < 4) mask &= (1 << (count - (blk << 2))) - 1;
+			for (int i = 0; mask; ++i, mask >>= 1)
+				if ((mask & 1) && !onEle((blk << 2) + i)) return false;
+		}
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Save(std::ostream& out, F&& idOf) const {
+		typedef QTSnapshotNodeT<Coord> SnapshotNode;
+		const int nodeCount = static_cast<int>(nodes.size());
+		QTVector<int, Alloc> eleBegin(nodeCount + 1, 0, alloc), blockBegin(nodeCount + 1, 0, alloc);
+		for (int i = 0; i < nodeCount; ++i) {
+			const int count = static_cast<int>(nodeEles[i].ids.size());
+			eleBegin[i + 1] = eleBegin[i] + count;
+			blockBegin[i + 1] = blockBegin[i] + (count + 3) / 4;
+		}
+		QTSnapshotHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, "LQTS", 4);
+		header.version = QTSnapshotHeader::VERSION;
+		header.coordSize = sizeof(Coord);
+		header.coordFloat = static_cast<Coord>(0.5) != 0;
+		header.maxDepth = maxDepth;
+		header.maxElePerLeaf = maxElePerLeaf;
+		header.adaptive = adaptive;
+		header.autoGrow = autoGrow;
+		header.grownLevels = grownLevels;
+		header.freeNode = free_node;
+		header.nodeCount = nodeCount;
+		header.eleCount = eleBegin[nodeCount];
+		header.blockCount = blockBegin[nodeCount];
+		header.looseFactor = looseFactor;
+		// the sections follow the header in the order of their offsets
+		unsigned long long offset = sizeof(header);
+		const auto section = [&offset](std::size_t bytes) {
+			const unsigned long long at = offset;
+			offset += (bytes + 7) & ~static_cast<std::size_t>(7);
+			return at;
+		};
+		header.root = section(sizeof(Rect) + sizeof(Point));
+		header.halfSizes = section(sizeof(Point) * halfSizes.size());
+		header.nodes = section(sizeof(SnapshotNode) * nodeCount);
+		header.childRects = section(sizeof(Rect4) * childRects.size());
+		header.eleBegin = section(sizeof(int) * (nodeCount + 1));
+		header.blockBegin = section(sizeof(int) * (nodeCount + 1));
+		header.rects = section(sizeof(Rect4) * header.blockCount);
+		header.ids = section(sizeof(unsigned long long) * header.eleCount);
+		const auto write = [&out](const void* p, std::size_t bytes) {
+			static const char zeros[8] = {};
+			out.write(static_cast<const char*>(p), bytes);
+			out.write(zeros, (8 - bytes % 8) % 8);
+		};
+		write(&header, sizeof(header));
+		const Coord root[6] = { rootRect.l, rootRect.t, rootRect.r, rootRect.b, rootCenter.x, rootCenter.y };
+		write(root, sizeof(root));
+		write(halfSizes.data(), sizeof(Point) * halfSizes.size());
+		// value initialized, so the reserved field is 0
+		QTVector<SnapshotNode, Alloc> snapshotNodes(nodeCount, SnapshotNode(), alloc);
+		for (int i = 0; i < nodeCount; ++i) {
+			SnapshotNode& sn = snapshotNodes[i];
+			sn.aabbRect = nodes[i].aabbRect;
+			sn.first_child = nodes[i].first_child;
+			sn.count = nodes[i].count;
+			sn.dirty = nodes[i].dirty;
+		}
+		write(snapshotNodes.data(), sizeof(SnapshotNode) * nodeCount);
+		write(childRects.data(), sizeof(Rect4) * childRects.size());
+		write(eleBegin.data(), sizeof(int) * (nodeCount + 1));
+		write(blockBegin.data(), sizeof(int) * (nodeCount + 1));
+		// lanes after the last element of a node may keep erased rects, they are saved as 0
+		QTVector<Rect4, Alloc> blocks(alloc);
+		QTVector<unsigned long long, Alloc> ids(alloc);
+		blocks.reserve(header.blockCount);
+		ids.reserve(header.eleCount);
+		for (int i = 0; i < nodeCount; ++i) {
+			const Eles& ne = nodeEles[i];
+			const int count = static_cast<int>(ne.ids.size());
+			for (int b = 0; b < (count + 3) / 4; ++b) {
+				Rect4 block;
+				for (int lane = 0; lane < 4 && 4 * b + lane < count; ++lane)
+					block.Set(lane, ne.GetRect(4 * b + lane));
+				blocks.push_back(block);
+			}
+			for (int k = 0; k < count; ++k)
+				ids.push_back(static_cast<unsigned long long>(idOf(ne.payloads[k])));
+		}
+		write(blocks.data(), sizeof(Rect4) * blocks.size());
+		write(ids.data(), sizeof(unsigned long long) * ids.size());
+		return static_cast<bool>(out);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Load(const void* data, std::size_t size, F&& payloadOf, QNodeEleHandle* handles) {
+		typedef QTSnapshotNodeT<Coord> SnapshotNode;
+		const QTSnapshotHeader* header = GetSnapshotHeader<Coord>(data, size);
+		if (!header || header->nodeCount > QNodeEleInfo::NO_NODE || (MaxDepth > 0 && header->maxDepth != MaxDepth) ||
+			(MaxElePerLeaf > 0 && header->maxElePerLeaf != MaxElePerLeaf)) return false;
+		const char* base = static_cast<const char*>(data);
+		const int nodeCount = header->nodeCount;
+		const SnapshotNode* snapshotNodes = reinterpret_cast<const SnapshotNode*>(base + header->nodes);
+		const int* eleBegin = reinterpret_cast<const int*>(base + header->eleBegin);
+		const int* blockBegin = reinterpret_cast<const int*>(base + header->blockBegin);
+		resetForBuild(header->eleCount);
+		const Coord* root = reinterpret_cast<const Coord*>(base + header->root);
+		rootRect = Rect(root[0], root[1], root[2], root[3]);
+		rootCenter = Point(root[4], root[5]);
+		const Point* sizes = reinterpret_cast<const Point*>(base + header->halfSizes);
+		halfSizes.assign(sizes, sizes + header->maxDepth + 1);
+		maxDepth = header->maxDepth;
+		maxElePerLeaf = header->maxElePerLeaf;
+		adaptive = header->adaptive != 0;
+		autoGrow = header->autoGrow != 0;
+		grownLevels = header->grownLevels;
+		looseFactor = static_cast<Real>(header->looseFactor);
+		free_node = header->freeNode;
+		const Rect4* rects = reinterpret_cast<const Rect4*>(base + header->childRects);
+		childRects.assign(rects, rects + (nodeCount - 1) / 4);
+		const Rect4* blocks = reinterpret_cast<const Rect4*>(base + header->rects);
+		const unsigned long long* ids = reinterpret_cast<const unsigned long long*>(base + header->ids);
+		nodes.resize(nodeCount);
+		nodeEles.resize(nodeCount, Eles(alloc));
+		// element k of the snapshot takes info k
+		for (int i = 0; i < nodeCount; ++i) {
+			Node& node = nodes[i];
+			node.aabbRect = snapshotNodes[i].aabbRect;
+			node.first_child = snapshotNodes[i].first_child;
+			node.count = snapshotNodes[i].count;
+			node.dirty = snapshotNodes[i].dirty != 0;
+			Eles& ne = nodeEles[i];
+			ne.rects.assign(blocks + blockBegin[i], blocks + blockBegin[i + 1]);
+			ne.Reserve(eleBegin[i + 1] - eleBegin[i]);
+			for (int k = eleBegin[i]; k < eleBegin[i + 1]; ++k) {
+				ne.payloads.push_back(payloadOf(ids[k]));
+				ne.ids.push_back(k);
+			}
+			linkEles(i);
+		}
+		if (handles)
+			for (int k = 0; k < header->eleCount; ++k) handles[k] = { k, eleInfos[k].gen };
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::ForEachIntersectingPair(F&& onPair) const {
+		selfPairs(0, onPair);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Join(const BasicQuadTree& lhs, const BasicQuadTree& rhs, F&& onPair) {
+		crossPairs(lhs, 0, rhs, 0, onPair);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::selfPairs(int idx, F& onPair) const {
+		const Node& node = nodes[idx];
+		// pairs inside the elements of the node, a branch has some in the loose mode only
+		const Eles& ne = nodeEles[idx];
+		for (int a = 0; a < static_cast<int>(ne.ids.size()); ++a) {
+			const Element ea = ne.Get(a);
+			const bool goOn = scanEles(idx, ea.rect, a + 1, [&](int b) {
+				return static_cast<bool>(onPair(ea, ne.Get(b)));
+			});
+			if (!goOn) return false;
+		}
+		if (node.count == -1) { // it's branch
+			// pairs between the branch's elements and every child, pairs inside every child,
+			// then pairs between every two children
+			for (int i = 0; i < 4; ++i)
+				if (!nodeElePairs(*this, idx, *this, node.first_child + i, true, onPair)) return false;
+			for (int i = 0; i < 4; ++i)
+				if (!selfPairs(node.first_child + i, onPair)) return false;
+			for (int i = 0; i < 3; ++i)
+				for (int j = i + 1; j < 4; ++j)
+					if (!crossPairs(*this, node.first_child + i, *this, node.first_child + j, onPair)) return false;
+		}
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::crossPairs(const BasicQuadTree& lhs, int lIdx,
+		const BasicQuadTree& rhs, int rIdx, F& onPair) {
+		const Node& ln = lhs.nodes[lIdx];
+		const Node& rn = rhs.nodes[rIdx];
+		if (ln.count == 0 || rn.count == 0 || !IsRectsIntersect(ln.aabbRect, rn.aabbRect)) return true;
+		if (ln.count != -1 && rn.count != -1) { // both are leaves
+			const Eles& lne = lhs.nodeEles[lIdx];
+			const Eles& rne = rhs.nodeEles[rIdx];
+			for (int a = 0; a < ln.count; ++a) {
+				const Element ea = lne.Get(a);
+				if (!IsRectsIntersect(ea.rect, rn.aabbRect)) continue;
+				const bool goOn = rhs.scanEles(rIdx, ea.rect, 0, [&](int b) {
+					return static_cast<bool>(onPair(ea, rne.Get(b)));
+				});
+				if (!goOn) return false;
+			}
+			return true;
+		}
+		// split the branch, or the larger one if both are branches.
+		// only the children intersecting the other side are visited
+		if (rn.count != -1 || (ln.count == -1 && GetRectArea(ln.aabbRect) >= GetRectArea(rn.aabbRect))) {
+			if (!nodeElePairs(lhs, lIdx, rhs, rIdx, true, onPair)) return false;
+			const int mask = GetShapeIntersectMask(rn.aabbRect, lhs.childRects[(ln.first_child - 1) >> 2]);
+			for (int i = 0; i < 4; ++i)
+				if ((mask & (1 << i)) && !crossPairs(lhs, ln.first_child + i, rhs, rIdx, onPair)) return false;
+		}
+		else {
+			if (!nodeElePairs(rhs, rIdx, lhs, lIdx, false, onPair)) return false;
+			const int mask = GetShapeIntersectMask(ln.aabbRect, rhs.childRects[(rn.first_child - 1) >> 2]);
+			for (int i = 0; i < 4; ++i)
+				if ((mask & (1 << i)) && !crossPairs(lhs, lIdx, rhs, rn.first_child + i, onPair)) return false;
+		}
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename F>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::nodeElePairs(const BasicQuadTree& src, int idx,
+		const BasicQuadTree& other, int oIdx, bool srcIsLhs, F& onPair) {
+		const Eles& ne = src.nodeEles[idx];
+		bool goOn = true;
+		for (int a = 0; a < static_cast<int>(ne.ids.size()) && goOn; ++a) {
+			const Element ea = ne.Get(a);
+			auto onHit = [&](const Element& eb) {
+				goOn = static_cast<bool>(srcIsLhs ? onPair(ea, eb) : onPair(eb, ea));
+				return goOn;
+			};
+			other.query(ea.rect, onHit, GetThreadQueryScratch(), oIdx);
+		}
+		return goOn;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::BasicQuadTree(Rect rect, int maxDepth, int maxElePerLeaf, Real looseFactor, bool autoGrow, const Alloc& alloc)
+		: alloc(alloc), eleInfos(alloc), free_ele(-1), nodes(alloc), nodeEles(alloc), childRects(alloc), free_node(-1),
+		nodeCapacity(0), eleCapacity(0), maxDepth(MaxDepth > 0 ? MaxDepth : maxDepth > 0 ? std::min(maxDepth, QT_MAX_DEPTH) : 24),
+		adaptive(MaxDepth <= 0 && maxDepth <= 0),
+		maxElePerLeaf(MaxElePerLeaf > 0 ? MaxElePerLeaf : maxElePerLeaf), rootRect(rect), autoGrow(MaxDepth <= 0 && autoGrow),
+		grownLevels(0), halfSizes(alloc), looseFactor(looseFactor >= 1 ? looseFactor : 0) {
+		Node root;
+		nodes.push_back(root);
+		nodeEles.push_back(Eles(alloc));
+		resetRoot();
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::BasicQuadTree(Rect rect, const Element* first, const Element* last,
+		int maxDepth, int maxElePerLeaf, QNodeEleHandle* handles, Real looseFactor, bool autoGrow, const Alloc& alloc)
+		: BasicQuadTree(rect, maxDepth, maxElePerLeaf, looseFactor, autoGrow, alloc) {
+		Build(first, last, handles);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Build(const Element* first, const Element* last, QNodeEleHandle* handles) {
+		const int n = static_cast<int>(last - first);
+		resetForBuild(n);
+		if (autoGrow) {
+			resetRoot();
+			for (int i = 0; i < n; ++i) growFor(GetRectCenter(first[i].rect));
+		}
+		// sort by morton code, then every node's elements are a contiguous range
+		QTVector<std::pair<unsigned long long, int>, Alloc> codes(n, std::pair<unsigned long long, int>(), alloc);
+		for (int i = 0; i < n; ++i)
+			codes[i] = { mortonCode(GetRectCenter(first[i].rect)), i };
+		std::sort(codes.begin(), codes.end());
+		build(0, first, codes.data(), codes.data() + n, 1, rootCenter);
+		for (int i = 0; i < static_cast<int>(nodes.size()); ++i)
+			linkEles(i);
+		if (handles)
+			for (int i = 0; i < n; ++i) handles[i] = { i, eleInfos[i].gen };
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Build(const Element* first, const Element* last, QTThreadPool& pool, QNodeEleHandle* handles) {
+		// the parts are built without knowing how many nodes the others take
+		if (nodeCapacity > 0) {
+			Build(first, last, handles);
+			return;
+		}
+		typedef std::pair<unsigned long long, int> Code;
+		const int n = static_cast<int>(last - first);
+		resetForBuild(n);
+		if (autoGrow) {
+			resetRoot();
+			for (int i = 0; i < n; ++i) growFor(GetRectCenter(first[i].rect));
+		}
+		// enough parts to keep every thread busy while some parts are larger than others
+		const int grain = std::max(n / (8 * static_cast<int>(pool.Size())), 1024);
+		QTThreadPool::TaskGroup group;
+		QTVector<Code, Alloc> codes(n, Code(), alloc);
+		for (int b = 0; b < n; b += grain) {
+			pool.Run(group, [&, b]() {
+				for (int i = b; i < std::min(b + grain, n); ++i)
+					codes[i] = { mortonCode(GetRectCenter(first[i].rect)), i };
+			});
+		}
+		pool.Wait(group);
+		// a large range becomes a branch of this tree and is split by its two bits,
+		// a small one is sorted and built in a tree of its own. nodes of this tree are locked by mutex
+		struct Part {
+			int idx;
+			std::unique_ptr<BasicQuadTree> tree;
+		};
+		QTVector<Part, Alloc> parts(alloc);
+		QTVector<int, Alloc> branches(alloc);
+		std::mutex mutex;
+		std::function<void(int, Code*, Code*, int, Point)> split = [&](int idx, Code* cf, Code* cl, int depth, Point cp) {
+			const int count = static_cast<int>(cl - cf);
+			const bool small = count <= grain || count <= leafCapacity() || depth >= depthLimit();
+			// in the loose mode the elements which don't fit a child are kept by the branch
+			Code* rest = cf;
+			if (!small && looseFactor > 0)
+				rest = std::partition(cf, cl, [&](const Code& c) { return !fitsChild(first[c.second].rect, cp, depth); });
+			// the same bits as build, depthLimit() <= QT_MAX_DEPTH keeps the shift inside the code
+			const int shift = 2 * (depthLimit() - 1 - depth);
+			// the leaf condition of build, the part is built alone and its root becomes the leaf.
+			// the codes aren't sorted yet, so every one is compared for the same child
+			if (small || rest == cl ||
+				(rest == cf && std::all_of(cf, cl, [&](const Code& c) { return ((c.first ^ cf->first) >> shift) == 0; })) ||
+				(adaptive && std::none_of(rest, cl, [&](const Code& c) { return fitsChildSize(first[c.second].rect, depth); }))) {
+				std::sort(cf, cl);
+				std::unique_ptr<BasicQuadTree> tree(new BasicQuadTree(rootRect, maxDepth, maxElePerLeaf, looseFactor, false, alloc));
+				// root may have grown, and maxDepth is the limit of the adaptive mode
+				tree->halfSizes = halfSizes;
+				tree->adaptive = adaptive;
+				tree->build(0, first, cf, cl, depth, cp);
+				std::lock_guard<std::mutex> lock(mutex);
+				parts.push_back({ idx, std::move(tree) });
+				return;
+			}
+			int first_child;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				insert4Nodes(first_child);
+				nodes[idx].first_child = first_child;
+				nodes[idx].count = -1;
+				if (looseFactor > 0) {
+					nodes[idx].aabbRect = looseCell(cp, depth);
+					for (Code* it = cf; it != rest; ++it) {
+						nodeEles[idx].Push(first[it->second], it->second);
+						UnionRect(nodes[idx].aabbRect, first[it->second].rect);
+					}
+					syncAABB(idx);
+				}
+				branches.push_back(idx);
+			}
+			Code* mid[5] = { rest, nullptr, nullptr, nullptr, cl };
+			mid[2] = std::partition(rest, cl, [shift](const Code& c) { return ((c.first >> shift) & 3) < 2; });
+			mid[1] = std::partition(rest, mid[2], [shift](const Code& c) { return ((c.first >> shift) & 3) < 1; });
+			mid[3] = std::partition(mid[2], cl, [shift](const Code& c) { return ((c.first >> shift) & 3) < 3; });
+			for (int i = 0; i < 4; ++i) {
+				const Point ccp = childCenter(cp, i, depth + 1);
+				pool.Run(group, [&split, first_child, i, mid, depth, ccp]() { split(first_child + i, mid[i], mid[i + 1], depth + 1, ccp); });
+			}
+		};
+		split(0, codes.data(), codes.data() + n, 1, rootCenter);
+		pool.Wait(group);
+		// node k > 0 of a part becomes node base + k - 1, its root takes the place of the part
+		QTVector<int, Alloc> bases(parts.size(), 0, alloc);
+		int size = static_cast<int>(nodes.size());
+		for (int p = 0; p < static_cast<int>(parts.size()); ++p) {
+			bases[p] = size;
+			size += static_cast<int>(parts[p].tree->nodes.size()) - 1;
+		}
+		// the parts don't know each other's nodes, together they may pass the limit of canInsert4Nodes
+		if (size > QNodeEleInfo::NO_NODE) {
+			Build(first, last, handles);
+			return;
+		}
+		nodes.resize(size);
+		nodeEles.resize(size, Eles(alloc));
+		childRects.resize((size - 1) >> 2);
+		for (int p = 0; p < static_cast<int>(parts.size()); ++p) {
+			pool.Run(group, [&, p]() {
+				BasicQuadTree& tree = *parts[p].tree;
+				const int base = bases[p];
+				for (int k = 0; k < static_cast<int>(tree.nodes.size()); ++k) {
+					const int idx = k == 0 ? parts[p].idx : base + k - 1;
+					nodes[idx] = tree.nodes[k];
+					if (nodes[idx].first_child != -1) nodes[idx].first_child += base - 1;
+					nodeEles[idx] = std::move(tree.nodeEles[k]);
+					linkEles(idx);
+				}
+				std::copy(tree.childRects.begin(), tree.childRects.end(), childRects.begin() + ((base - 1) >> 2));
+				syncAABB(parts[p].idx);
+				parts[p].tree.reset();
+			});
+		}
+		pool.Wait(group);
+		// children are created after their parent, so the aabbs are built from bottom to top.
+		// loose cells are set already
+		for (auto it = branches.rbegin(); it != branches.rend(); ++it) {
+			linkEles(*it);
+			if (looseFactor <= 0) unionChildren(*it);
+		}
+		if (handles)
+			for (int i = 0; i < n; ++i) handles[i] = { i, eleInfos[i].gen };
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	QNodeEleHandle BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Insert(const Element& ele) {
+		int eleIdx;
+		if (free_ele != -1) {
+			eleIdx = free_ele;
+			free_ele = eleInfos[eleIdx].slot;
+		}
+		else {
+			if (eleCapacity > 0 && static_cast<int>(eleInfos.size()) >= eleCapacity) return QNodeEleHandle();
+			eleIdx = eleInfos.size();
+			eleInfos.push_back({});
+		}
+		if (autoGrow) growFor(GetRectCenter(ele.rect));
+		insert(ele, eleIdx);
+		return { eleIdx, eleInfos[eleIdx].gen };
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Erase(const Element& ele) {
+		int leafNodeIdx = 0;
+		queryLeaf(ele.rect, leafNodeIdx);
+		const Eles& ne = nodeEles[leafNodeIdx];
+		for (int i = 0; i < static_cast<int>(ne.ids.size()); ++i) {
+			if (ne.Get(i) == ele) {
+				const int eleIdx = ne.ids[i];
+				markDirty(GetRectCenter(ele.rect));
+				removeEle(leafNodeIdx, i);
+				freeEle(eleIdx);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Erase(const QNodeEleHandle& handle) {
+		if (!IsValid(handle)) return false;
+		const QNodeEleInfo& info = eleInfos[handle.idx];
+		markDirty(GetRectCenter(nodeEles[info.node].GetRect(info.slot)));
+		removeEle(info.node, info.slot);
+		freeEle(handle.idx);
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::IsValid(const QNodeEleHandle& handle) const {
+		return handle.idx >= 0 && handle.idx < static_cast<int>(eleInfos.size()) &&
+			eleInfos[handle.idx].gen == handle.gen && eleInfos[handle.idx].node != QNodeEleInfo::NO_NODE;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Move(const QNodeEleHandle& handle, const Rect& rect) {
+		if (!IsValid(handle)) return false;
+		const Point cp = GetRectCenter(rect);
+		if (autoGrow) growFor(cp);
+		int leafIdx;
+		queryLeaf(rect, leafIdx);
+		const QNodeEleInfo& info = eleInfos[handle.idx];
+		if (leafIdx == info.node && looseFactor > 0) {
+			// the element still fits the cell, only root may keep elements out of its cell
+			nodeEles[leafIdx].SetRect(info.slot, rect);
+			if (leafIdx == 0) {
+				UnionRect(nodes[0].aabbRect, rect);
+				nodes[0].dirty = true;
+			}
+		}
+		else if (leafIdx == info.node) {
+			// the element stays in its leaf, the loose AABBs only need to grow
+			nodeEles[leafIdx].SetRect(info.slot, rect);
+			widenAABB(cp, rect);
+		}
+		else {
+			// the element keeps its info, so the handle stays valid
+			const Element ele(rect, nodeEles[info.node].payloads[info.slot]);
+			markDirty(GetRectCenter(nodeEles[info.node].GetRect(info.slot)));
+			removeEle(info.node, info.slot);
+			insert(ele, handle.idx);
+		}
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const Rect& rect, std::list<Element>& retList) const {
+		Query(rect, [&retList](const Element& ele) { retList.push_back(ele); return true; });
+		return retList.size();
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Query(const Point& point, std::list<Element>& retList) const {
+		Query(point, [&retList](const Element& ele) { retList.push_back(ele); return true; });
+		return retList.size();
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	int BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::QueryNearest(const Point& point, int k, Real maxDist,
+		std::vector<std::pair<Real, Element>>& out, QueryScratch& scratch) const {
+		typedef std::pair<double, int> NodeDist;
+		typedef std::pair<Real, Element> EleDist;
+		// out is a max heap of the k nearest so far, nodeHeap is a min heap of the nodes to visit
+		const auto eleLess = [](const EleDist& a, const EleDist& b) { return a.first < b.first; };
+		const auto nodeGreater = [](const NodeDist& a, const NodeDist& b) { return a.first > b.first; };
+		out.clear();
+		if (k <= 0 || maxDist < 0) return 0;
+		const Real maxSq = maxDist * maxDist;
+		// a node is useful if it's nearer than maxDist and the k-th element found
+		const auto bound = [&]() { return static_cast<int>(out.size()) < k ? maxSq : out.front().first; };
+		std::vector<NodeDist>& heap = scratch.nodeHeap;
+		const std::size_t base = heap.size();
+		QUADTREE_COUNT(scratch, queries, 1);
+		if (nodes[0].count != 0) {
+			const Real d = GetRectPointDistanceSq(nodes[0].aabbRect, point);
+			if (d <= maxSq) heap.push_back({ d, 0 });
+		}
+		while (heap.size() > base) {
+			std::pop_heap(heap.begin() + base, heap.end(), nodeGreater);
+			const NodeDist nd = heap.back();
+			heap.pop_back();
+			// every node left is farther
+			if (nd.first > bound()) break;
+			const Node& node = nodes[nd.second];
+			// elements of a leaf, or of a branch in the loose mode
+			const Eles& ne = nodeEles[nd.second];
+			QUADTREE_COUNT(scratch, nodesVisited, 1);
+			QUADTREE_COUNT(scratch, elementTests, ne.ids.size());
+			for (int i = 0; i < static_cast<int>(ne.ids.size()); ++i) {
+				const Real d = GetRectPointDistanceSq(ne.GetRect(i), point);
+				if (d > bound()) continue;
+				if (static_cast<int>(out.size()) == k) {
+					std::pop_heap(out.begin(), out.end(), eleLess);
+					out.pop_back();
+				}
+				out.push_back({ d, ne.Get(i) });
+				std::push_heap(out.begin(), out.end(), eleLess);
+			}
+			if (node.count == -1) { // it's branch
+				const Rect4& rects = childRects[(node.first_child - 1) >> 2];
+				for (int i = 0; i < 4; ++i) {
+					if (nodes[node.first_child + i].count == 0) continue;
+					const Real d = GetRectPointDistanceSq(rects.Get(i), point);
+					if (d > bound()) continue;
+					heap.push_back({ d, node.first_child + i });
+					std::push_heap(heap.begin() + base, heap.end(), nodeGreater);
+				}
+			}
+		}
+		heap.resize(base);
+		QUADTREE_COUNT(scratch, hits, out.size());
+		std::sort_heap(out.begin(), out.end(), eleLess);
+		for (EleDist& ed : out)
+			ed.first = std::sqrt(ed.first);
+		return static_cast<int>(out.size());
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::QueryNearest(const Point& point, Real maxDist, Element& nearest, Real* dist) const {
+		if (maxDist < 0) return false;
+		Real bestSq = maxDist * maxDist;
+		bool found = false;
+		if (nodes[0].count != 0 && GetRectPointDistanceSq(nodes[0].aabbRect, point) <= bestSq)
+			this->nearest(0, point, bestSq, nearest, found);
+		if (found && dist) *dist = std::sqrt(bestSq);
+		return found;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::QueryBatch(const Rect* first, const Rect* last, BatchResult& result,
+		QTThreadPool& pool, bool mortonOrder) const {
+		queryBatch(first, last, result, pool, mortonOrder);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::QueryBatch(const Point* first, const Point* last, BatchResult& result,
+		QTThreadPool& pool, bool mortonOrder) const {
+		queryBatch(first, last, result, pool, mortonOrder);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Cleanup() {
+		int temp;
+		cleanupHelper(0, temp);
+		if (grownLevels > 0) shrinkRoot();
+		// root's own elements may have moved out of its cell
+		if (looseFactor > 0) looseRootAABB();
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Cleanup(int maxNodes) {
+		if (!cleanupDirty(0, maxNodes)) return false;
+		// only a clean tree knows which children are empty
+		if (grownLevels > 0) shrinkRoot();
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Compact() {
+		int live = static_cast<int>(nodes.size());
+		for (int i = free_node; i != -1; i = nodes[i].first_child)
+			live -= 4;
+		// the new leaves are allocated in the order of the nodes, so close nodes tend to get close memory
+		QTVector<Node, Alloc> newNodes(alloc);
+		QTVector<Eles, Alloc> newEles(alloc);
+		QTVector<Rect4, Alloc> newRects(alloc);
+		// keep the room Reserve made for the hard capacity
+		const int capacity = std::max(live, nodeCapacity);
+		newNodes.reserve(capacity);
+		newEles.reserve(capacity);
+		newRects.reserve((capacity - 1) / 4);
+		newNodes.push_back(nodes[0]);
+		newEles.push_back(packEles(0));
+		compactHelper(0, 0, newNodes, newEles, newRects);
+		nodes.swap(newNodes);
+		nodeEles.swap(newEles);
+		childRects.swap(newRects);
+		free_node = -1;
+		for (int i = 0; i < static_cast<int>(nodes.size()); ++i)
+			linkEles(i);
+		// infos can't be dropped, a stale handle would match a new element in the same slot
+		free_ele = -1;
+		for (int i = static_cast<int>(eleInfos.size()) - 1; i >= 0; --i) {
+			if (eleInfos[i].node != QNodeEleInfo::NO_NODE) continue;
+			eleInfos[i].slot = free_ele;
+			free_ele = i;
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::Reserve(int nodeCount, int eleCount, bool hardCapacity) {
+		// root and groups of 4 children
+		nodeCount = std::max(1 + (std::max(nodeCount, 1) - 1) / 4 * 4, static_cast<int>(nodes.size()));
+		eleCount = std::max(eleCount, static_cast<int>(eleInfos.size()));
+		nodes.reserve(nodeCount);
+		nodeEles.reserve(nodeCount);
+		childRects.reserve((nodeCount - 1) / 4);
+		eleInfos.reserve(eleCount);
+		nodeCapacity = hardCapacity ? nodeCount : 0;
+		eleCapacity = hardCapacity ? eleCount : 0;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	QTStats BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::GetStats() const {
+		QTStats stats = {};
+		stats.leafHistogram.assign(leafCapacity() + 2, 0);
+		statsHelper(0, 1, stats);
+		stats.averageDepth /= stats.leafCount;
+		stats.nodeSlots = static_cast<int>(nodes.size());
+		// free nodes are linked four at a time by their first one
+		for (int i = free_node; i != -1; i = nodes[i].first_child)
+			stats.freeNodeSlots += 4;
+		stats.eleInfoSlots = static_cast<int>(eleInfos.size());
+		for (int i = free_ele; i != -1; i = eleInfos[i].slot)
+			++stats.freeEleInfoSlots;
+		return stats;
+	}
+
+	/*=======
+	! PRIVATE !
+	=======*/
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::insert4Nodes(int& i) {
+		if (free_node != -1) {
+			i = free_node;
+			free_node = nodes[i].first_child;
+			nodes[i + 0] = Node();
+			nodes[i + 1] = Node();
+			nodes[i + 2] = Node();
+			nodes[i + 3] = Node();
+			childRects[(i - 1) >> 2] = Rect4();
+		}
+		else {
+			i = nodes.size();
+			nodes.push_back({});
+			nodes.push_back({});
+			nodes.push_back({});
+			nodes.push_back({});
+			nodeEles.resize(nodes.size(), Eles(alloc));
+			childRects.push_back({});
+		}
+	}
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::canInsert4Nodes() const {
+		const int size = static_cast<int>(nodes.size()) + 4;
+		return free_node != -1 || (size <= QNodeEleInfo::NO_NODE && (nodeCapacity == 0 || size <= nodeCapacity));
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::eraseNodes(const int& idx) {
+		// the four children go back to the free list, not the node itself
+		nodes[nodes[idx].first_child].first_child = free_node;
+		free_node = nodes[idx].first_child;
+		// a loose cell stays, it's the bounds of the node whatever it keeps
+		if (looseFactor <= 0) nodes[idx].aabbRect = {};
+		nodes[idx].count = 0;
+		nodes[idx].first_child = -1;
+		syncAABB(idx);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline int BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::descend(const Point& xcp, Point& cp, const Point& offset) {
+		if (xcp.x > cp.x) { // right side
+			if (xcp.y > cp.y) { // down
+				cp.x += offset.x; cp.y += offset.y; return 3;
+			}
+			else { // up
+				cp.x += offset.x; cp.y -= offset.y; return 2;
+			}
+		}
+		else { // left side
+			if (xcp.y > cp.y) { // down
+				cp.x -= offset.x; cp.y += offset.y; return 1;
+			}
+			else { // up
+				cp.x -= offset.x; cp.y -= offset.y; return 0;
+			}
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline int BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::depthLimit() const {
+		return MaxDepth > 0 ? MaxDepth : maxDepth;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline int BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::leafCapacity() const {
+		return MaxElePerLeaf > 0 ? MaxElePerLeaf : maxElePerLeaf;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline QTPointT<Coord> BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::childCenter(const Point& cp, const int& i, const int& depth) const {
+		// same arithmetic as descend
+		const Point& offset = halfSizes[depth];
+		return { i & 2 ? cp.x + offset.x : cp.x - offset.x, i & 1 ? cp.y + offset.y : cp.y - offset.y };
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline QTRectT<Coord> BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::looseCell(const Point& cp, const int& depth) const {
+		const Real x = looseFactor * halfSizes[depth].x, y = looseFactor * halfSizes[depth].y;
+		return { static_cast<Coord>(cp.x - x), static_cast<Coord>(cp.y - y),
+			static_cast<Coord>(cp.x + x), static_cast<Coord>(cp.y + y) };
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::fitsChild(const Rect& rect, const Point& cp, const int& depth) const {
+		if (looseFactor <= 0) return true;
+		// the child of the center, the element fits if the child's cell contains it
+		Point ccp = cp;
+		descend(GetRectCenter(rect), ccp, halfSizes[depth + 1]);
+		const Rect cell = looseCell(ccp, depth + 1);
+		return rect.l >= cell.l && rect.r <= cell.r && rect.t >= cell.t && rect.b <= cell.b;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::fitsChildSize(const Rect& rect, const int& depth) const {
+		if (!adaptive) return true;
+		const Point& half = halfSizes[depth + 1];
+		return half.x > 0 && half.y > 0 && rect.r - rect.l <= 2 * half.x && rect.b - rect.t <= 2 * half.y;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::looseRootAABB() {
+		// elements too large for root, or out of it, are kept by root too
+		const Eles& ne = nodeEles[0];
+		nodes[0].aabbRect = looseCell(rootCenter, 1);
+		for (int i = 0; i < static_cast<int>(ne.ids.size()); ++i)
+			UnionRect(nodes[0].aabbRect, ne.GetRect(i));
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::growFor(const Point& xcp) {
+		while (xcp.x < rootCenter.x - halfSizes[1].x || xcp.x > rootCenter.x + halfSizes[1].x ||
+			xcp.y < rootCenter.y - halfSizes[1].y || xcp.y > rootCenter.y + halfSizes[1].y)
+			if (!growRoot(xcp)) return;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::growRoot(const Point& xcp) {
+		if (maxDepth >= QT_MAX_DEPTH) return false; // levels of a morton code
+		const Point half = halfSizes[1];
+		const Point center = { xcp.x > rootCenter.x ? rootCenter.x + half.x : rootCenter.x - half.x,
+			xcp.y > rootCenter.y ? rootCenter.y + half.y : rootCenter.y - half.y };
+		// the descent from the new root must reach the old one exactly, or elements can't be found
+		Point cp = center;
+		const int q = descend(rootCenter, cp, half);
+		if (!(cp == rootCenter)) {
+			autoGrow = false;
+			return false;
+		}
+		// a root with elements needs 4 nodes to grow
+		if (nodes[0].count != 0 && !canInsert4Nodes()) return false;
+		halfSizes.insert(halfSizes.begin() + 1, Point(half.x * 2, half.y * 2));
+		++maxDepth;
+		++grownLevels;
+		rootCenter = center;
+		if (nodes[0].count == 0) { // an empty root only becomes larger
+			if (looseFactor > 0) looseRootAABB();
+			return true;
+		}
+		// the old root and its subtree move under the new root as they are
+		int first_child;
+		insert4Nodes(first_child);
+		const int child = first_child + q;
+		nodes[child] = nodes[0];
+		std::swap(nodeEles[child], nodeEles[0]);
+		linkEles(child);
+		syncAABB(child);
+		nodes[0] = Node(first_child, -1);
+		nodes[0].aabbRect = nodes[child].aabbRect;
+		nodes[0].dirty = nodes[child].dirty;
+		if (looseFactor > 0) {
+			for (int i = 0; i < 4; ++i) {
+				nodes[first_child + i].aabbRect = looseCell(childCenter(rootCenter, i, 2), 2);
+				syncAABB(first_child + i);
+			}
+			looseRootAABB();
+			// the old root kept what didn't fit its cell, it may fit the new root's children now
+			Eles moved(alloc);
+			std::swap(moved, nodeEles[child]);
+			if (nodes[child].count != -1) nodes[child].count = 0;
+			for (int i = 0; i < static_cast<int>(moved.ids.size()); ++i)
+				insert(moved.Get(i), moved.ids[i]);
+		}
+		return true;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::shrinkRoot() {
+		while (grownLevels > 0) {
+			if (nodes[0].count == 0) {
+				resetRoot();
+				return;
+			}
+			if (nodes[0].count != -1 || !nodeEles[0].ids.empty()) return;
+			const int first_child = nodes[0].first_child;
+			int q = -1;
+			for (int i = 0; i < 4; ++i) {
+				if (nodes[first_child + i].count == 0) continue;
+				if (q != -1) return;
+				q = i;
+			}
+			if (q == -1) return;
+			// undo of growRoot, the child and its subtree become the root as they are
+			const Node node = nodes[first_child + q];
+			nodes[first_child + q] = Node();
+			eraseNodes(0);
+			nodes[0] = node;
+			std::swap(nodeEles[0], nodeEles[first_child + q]);
+			linkEles(0);
+			rootCenter = childCenter(rootCenter, q, 2);
+			halfSizes.erase(halfSizes.begin() + 1);
+			--maxDepth;
+			--grownLevels;
+			if (looseFactor > 0) looseRootAABB();
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::resetRoot() {
+		if (MaxDepth <= 0) maxDepth -= grownLevels;
+		grownLevels = 0;
+		rootCenter = GetRectCenter(rootRect);
+		// every level is halved from the one above, the same arithmetic as a descent
+		halfSizes.resize(depthLimit() + 1);
+		halfSizes[1] = { (rootRect.r - rootRect.l) / 2, (rootRect.b - rootRect.t) / 2 };
+		for (int depth = 2; depth <= depthLimit(); ++depth)
+			halfSizes[depth] = { halfSizes[depth - 1].x / 2, halfSizes[depth - 1].y / 2 };
+		if (looseFactor > 0) looseRootAABB();
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	unsigned long long BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::mortonCode(const Point& xcp) const {
+		// same descent as insert, so rounding can't send an element to another leaf
+		Point cp = rootCenter;
+		unsigned long long code = 0;
+		for (int depth = 1; depth < depthLimit(); ++depth)
+			code = (code << 2) | descend(xcp, cp, halfSizes[depth + 1]);
+		return code;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::resetForBuild(const int& n) {
+		// element i takes info i, handles of the old elements become invalid
+		for (QNodeEleInfo& info : eleInfos)
+			if (info.node != QNodeEleInfo::NO_NODE) ++info.gen;
+		if (static_cast<int>(eleInfos.size()) < n) eleInfos.resize(n);
+		free_ele = -1;
+		for (int i = static_cast<int>(eleInfos.size()) - 1; i >= n; --i) {
+			eleInfos[i].node = QNodeEleInfo::NO_NODE;
+			eleInfos[i].slot = free_ele;
+			free_ele = i;
+		}
+		nodes.assign(1, Node());
+		nodeEles.assign(1, Eles(alloc));
+		childRects.clear();
+		free_node = -1;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::build(const int& idx, const Element* eles, std::pair<unsigned long long, int>* first,
+		std::pair<unsigned long long, int>* last, const int& depth, const Point& cp) {
+		const int n = static_cast<int>(last - first);
+		// in the loose mode the elements which don't fit a child are kept by this node,
+		// the others stay sorted
+		std::pair<unsigned long long, int>* rest = first;
+		if (looseFactor > 0 && n > leafCapacity() && depth < depthLimit())
+			rest = std::stable_partition(first, last, [&](const std::pair<unsigned long long, int>& c) {
+				return !fitsChild(eles[c.second].rect, cp, depth); });
+		if (looseFactor > 0) nodes[idx].aabbRect = looseCell(cp, depth);
+		// the rule of canSplit, the codes of the elements which go down are sorted so the first and the last
+		// tell whether they all go to the same child
+		if (n <= leafCapacity() || depth >= depthLimit() || rest == last || !canInsert4Nodes() ||
+			(rest == first && ((first->first ^ (last - 1)->first) >> (2 * (depthLimit() - 1 - depth))) == 0) ||
+			(adaptive && std::none_of(rest, last, [&](const std::pair<unsigned long long, int>& c) {
+				return fitsChildSize(eles[c.second].rect, depth); }))) { // it's leaf
+			Eles& ne = nodeEles[idx];
+			ne.Reserve(n);
+			for (const std::pair<unsigned long long, int>* it = first; it != last; ++it) {
+				const Rect& rect = eles[it->second].rect;
+				if (it == first && looseFactor <= 0) nodes[idx].aabbRect = rect;
+				else UnionRect(nodes[idx].aabbRect, rect);
+				ne.Push(eles[it->second], it->second);
+			}
+			nodes[idx].count = n;
+			syncAABB(idx);
+			return;
+		}
+		// it's branch, children's ranges are split by this level's two bits
+		int first_child;
+		insert4Nodes(first_child);
+		nodes[idx].first_child = first_child;
+		nodes[idx].count = -1;
+		for (std::pair<unsigned long long, int>* it = first; it != rest; ++it) {
+			nodeEles[idx].Push(eles[it->second], it->second);
+			UnionRect(nodes[idx].aabbRect, eles[it->second].rect);
+		}
+		first = rest;
+		const int shift = 2 * (depthLimit() - 1 - depth);
+		for (int i = 0; i < 4; ++i) {
+			std::pair<unsigned long long, int>* mid = std::partition_point(first, last,
+				[shift, i](const std::pair<unsigned long long, int>& c) { return static_cast<int>((c.first >> shift) & 3) <= i; });
+			build(first_child + i, eles, first, mid, depth + 1, childCenter(cp, i, depth + 1));
+			first = mid;
+		}
+		// aabb is built from bottom to top, a loose cell is set already
+		if (looseFactor > 0) syncAABB(idx);
+		else unionChildren(idx);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::linkEles(const int& idx) {
+		const Eles& ne = nodeEles[idx];
+		for (int i = 0; i < static_cast<int>(ne.ids.size()); ++i) {
+			eleInfos[ne.ids[i]].node = idx;
+			eleInfos[ne.ids[i]].slot = i;
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::unionChildren(const int& idx) {
+		const int first_child = nodes[idx].first_child;
+		bool init = false;
+		for (int i = 0; i < 4; ++i) {
+			if (nodes[first_child + i].count == 0) continue;
+			if (!init) { nodes[idx].aabbRect = nodes[first_child + i].aabbRect; init = true; }
+			else UnionRect(nodes[idx].aabbRect, nodes[first_child + i].aabbRect);
+		}
+		syncAABB(idx);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::nearest(const int& idx, const Point& point, Real& bestSq, Element& best, bool& found) const {
+		const Node& node = nodes[idx];
+		// elements of a leaf, or of a branch in the loose mode
+		const Eles& ne = nodeEles[idx];
+		for (int i = 0; i < static_cast<int>(ne.ids.size()); ++i) {
+			const Real d = GetRectPointDistanceSq(ne.GetRect(i), point);
+			if (d > bestSq || (found && d == bestSq)) continue;
+			bestSq = d;
+			best = ne.Get(i);
+			found = true;
+		}
+		if (node.count != -1) return; // it's leaf
+		// sort the non-empty children by distance, the nearer one may shrink bestSq for the others
+		const Rect4& rects = childRects[(node.first_child - 1) >> 2];
+		std::pair<Real, int> children[4];
+		int n = 0;
+		for (int i = 0; i < 4; ++i) {
+			if (nodes[node.first_child + i].count == 0) continue;
+			std::pair<Real, int> c = { GetRectPointDistanceSq(rects.Get(i), point), node.first_child + i };
+			int j = n++;
+			for (; j > 0 && children[j - 1].first > c.first; --j)
+				children[j] = children[j - 1];
+			children[j] = c;
+		}
+		for (int i = 0; i < n && children[i].first <= bestSq; ++i)
+			nearest(children[i].second, point, bestSq, best, found);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	QTPointT<Coord> BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::getShapeCenter(const Rect& rect) {
+		return GetRectCenter(rect);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	QTPointT<Coord> BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::getShapeCenter(const Point& point) {
+		return point;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	template<typename S>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::queryBatch(const S* first, const S* last, BatchResult& result,
+		QTThreadPool& pool, bool mortonOrder) const {
+		const int n = static_cast<int>(last - first);
+		// the queries in run order
+		QTVector<int, Alloc> order(n, 0, alloc);
+		if (mortonOrder) {
+			QTVector<std::pair<unsigned long long, int>, Alloc> codes(n, std::pair<unsigned long long, int>(), alloc);
+			for (int i = 0; i < n; ++i)
+				codes[i] = { mortonCode(getShapeCenter(first[i])), i };
+			std::sort(codes.begin(), codes.end());
+			for (int i = 0; i < n; ++i) order[i] = codes[i].second;
+		}
+		else {
+			for (int i = 0; i < n; ++i) order[i] = i;
+		}
+		// every part collects its hits alone, then they are copied to their offsets
+		const int grain = 256;
+		const int nPart = (n + grain - 1) / grain;
+		QTVector<QTVector<Element, Alloc>, Alloc> partHits(nPart, QTVector<Element, Alloc>(alloc), alloc);
+		result.offsets.assign(n + 1, 0);
+		QTThreadPool::TaskGroup group;
+		for (int p = 0; p < nPart; ++p) {
+			pool.Run(group, [&, p]() {
+				QTVector<Element, Alloc>& hits = partHits[p];
+				for (int o = p * grain; o < std::min(n, (p + 1) * grain); ++o) {
+					const std::size_t size = hits.size();
+					Query(first[order[o]], [&hits](const Element& ele) { hits.push_back(ele); return true; },
+						GetThreadQueryScratch());
+					result.offsets[order[o] + 1] = static_cast<int>(hits.size() - size);
+				}
+			});
+		}
+		pool.Wait(group);
+		for (int i = 0; i < n; ++i)
+			result.offsets[i + 1] += result.offsets[i];
+		result.hits.resize(result.offsets[n]);
+		for (int p = 0; p < nPart; ++p) {
+			pool.Run(group, [&, p]() {
+				typename QTVector<Element, Alloc>::const_iterator it = partHits[p].begin();
+				for (int o = p * grain; o < std::min(n, (p + 1) * grain); ++o) {
+					const int q = order[o];
+					const int count = result.offsets[q + 1] - result.offsets[q];
+					std::copy(it, it + count, result.hits.begin() + result.offsets[q]);
+					it += count;
+				}
+				QTVector<Element, Alloc>(alloc).swap(partHits[p]);
+			});
+		}
+		pool.Wait(group);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::insert(const Element& ele, const int& eleIdx) {
+		// cp: center of current node
+		// halfSizes[depth]: half size of current node
+		// cnIdx : current node index, it may be a branch or a leaf
+		// depth : current node's depth. Based depth is 1
+		const Point xcp = GetRectCenter(ele.rect);
+		Point cp = rootCenter;
+		int cnIdx = 0;
+		int depth = 1;
+		// branches are above maxDepth, so the loop has a constant bound when MaxDepth is given.
+		// in the loose mode a branch keeps the element if it doesn't fit the child
+		for (; depth < depthLimit() && nodes[cnIdx].count == -1 && fitsChild(ele.rect, cp, depth); ++depth) { // current node is a branch, so it need to insert to its child
+			updateAABBSinceInsert(ele.rect, cnIdx);
+			cnIdx = nodes[cnIdx].first_child + descend(xcp, cp, halfSizes[depth + 1]);
+		}
+		pushEle(cnIdx, ele, eleIdx);
+		// a leaf at maxDepth can't split, it keeps every element.
+		// it's the rule of split and build, elements too large for the children don't split a leaf
+		if (nodes[cnIdx].count > leafCapacity() && depth < depthLimit() && canSplit(cnIdx, cp, depth))
+			split(cnIdx, cp, depth);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::split(const int& idx, const Point& cp, const int& depth) {
+		int first_child;
+		insert4Nodes(first_child);
+		// after push some elements, variable node is invalid, since nodes's memory is changed
+		Eles moved(alloc);
+		std::swap(moved, nodeEles[idx]);
+		nodes[idx].first_child = first_child;
+		nodes[idx].count = -1;
+		if (looseFactor > 0) {
+			for (int i = 0; i < 4; ++i) {
+				nodes[first_child + i].aabbRect = looseCell(childCenter(cp, i, depth + 1), depth + 1);
+				syncAABB(first_child + i);
+			}
+		}
+		const Point& childOffset = halfSizes[depth + 1];
+		for (int i = 0; i < static_cast<int>(moved.ids.size()); ++i) {
+			const Element ele = moved.Get(i);
+			if (!fitsChild(ele.rect, cp, depth)) { // it's kept by the loose branch
+				pushEle(idx, ele, moved.ids[i]);
+				continue;
+			}
+			Point ccp = cp;
+			pushEle(first_child + descend(GetRectCenter(ele.rect), ccp, childOffset), ele, moved.ids[i]);
+		}
+		// every element may fall into the same child, which needs to split again
+		if (depth + 1 >= depthLimit()) return;
+		for (int i = 0; i < 4; ++i) {
+			if (nodes[first_child + i].count <= leafCapacity()) continue;
+			const Point ccp = childCenter(cp, i, depth + 1);
+			if (canSplit(first_child + i, ccp, depth + 1))
+				split(first_child + i, ccp, depth + 1);
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::canSplit(const int& idx, const Point& cp, const int& depth) const {
+		if (!canInsert4Nodes()) return false;
+		const Eles& ne = nodeEles[idx];
+		bool fits = false, apart = false;
+		int firstPlace = 0;
+		for (int i = 0; i < static_cast<int>(ne.ids.size()); ++i) {
+			const Rect rect = ne.GetRect(i);
+			// the child of the element, or -1 if the loose branch keeps it
+			int place = -1;
+			if (fitsChild(rect, cp, depth)) {
+				Point ccp = cp;
+				place = descend(GetRectCenter(rect), ccp, halfSizes[depth + 1]);
+				fits = fits || fitsChildSize(rect, depth);
+			}
+			if (i == 0) firstPlace = place;
+			else apart = apart || place != firstPlace;
+			if (fits && apart) return true;
+		}
+		return false;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::mergeChildren(const int& idx) {
+		const int first_child = nodes[idx].first_child;
+		// the bounds of the children are kept, a loose branch's own elements become the leaf's first ones
+		const Rect aabb = nodes[idx].aabbRect;
+		eraseNodes(idx);
+		nodes[idx].aabbRect = aabb;
+		nodes[idx].count = static_cast<int>(nodeEles[idx].ids.size());
+		for (int i = 0; i < 4; ++i) {
+			Eles& ne = nodeEles[first_child + i];
+			for (int k = 0; k < static_cast<int>(ne.ids.size()); ++k)
+				pushEle(idx, ne.Get(k), ne.ids[k]);
+			ne = Eles(alloc);
+		}
+		syncAABB(idx);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::queryLeaf(const Rect& rect, int& nodeIdx) {
+		const Point cp = GetRectCenter(rect);
+		Point xcp = rootCenter;
+		nodeIdx = 0;
+		for (int depth = 1; depth < depthLimit() && nodes[nodeIdx].count == -1 && fitsChild(rect, xcp, depth); ++depth)
+			nodeIdx = nodes[nodeIdx].first_child + descend(cp, xcp, halfSizes[depth + 1]);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::widenAABB(const Point& cp, const Rect& rect) {
+		Point xcp = rootCenter;
+		int nodeIdx = 0;
+		UnionRect(nodes[nodeIdx].aabbRect, rect);
+		syncAABB(nodeIdx);
+		nodes[nodeIdx].dirty = true;
+		for (int depth = 1; depth < depthLimit() && nodes[nodeIdx].count == -1; ++depth) {
+			nodeIdx = nodes[nodeIdx].first_child + descend(cp, xcp, halfSizes[depth + 1]);
+			UnionRect(nodes[nodeIdx].aabbRect, rect);
+			syncAABB(nodeIdx);
+			nodes[nodeIdx].dirty = true;
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::markDirty(const Point& cp) {
+		Point xcp = rootCenter;
+		int nodeIdx = 0;
+		nodes[nodeIdx].dirty = true;
+		for (int depth = 1; depth < depthLimit() && nodes[nodeIdx].count == -1; ++depth) {
+			nodeIdx = nodes[nodeIdx].first_child + descend(cp, xcp, halfSizes[depth + 1]);
+			nodes[nodeIdx].dirty = true;
+		}
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::pushEle(const int& idx, const Element& ele, const int& eleIdx) {
+		QNodeEleInfo& info = eleInfos[eleIdx];
+		info.node = idx;
+		// with a compile-time capacity a leaf allocates its elements once, until it splits
+		if (MaxElePerLeaf > 0 && nodes[idx].count == 0) nodeEles[idx].Reserve(MaxElePerLeaf + 1);
+		info.slot = static_cast<int>(nodeEles[idx].ids.size());
+		if (nodes[idx].count != -1) ++nodes[idx].count; // a branch has no count
+		nodeEles[idx].Push(ele, eleIdx);
+		updateAABBSinceInsert(ele.rect, idx);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::removeEle(const int& idx, const int& slot) {
+		// move the last element to the slot, so the elements stay contiguous
+		Eles& ne = nodeEles[idx];
+		const int last = static_cast<int>(ne.ids.size()) - 1;
+		if (nodes[idx].count != -1) --nodes[idx].count;
+		if (slot != last) {
+			ne.Set(slot, ne.Get(last), ne.ids[last]);
+			eleInfos[ne.ids[slot]].slot = slot;
+		}
+		ne.Pop();
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::freeEle(const int& eleIdx) {
+		QNodeEleInfo& info = eleInfos[eleIdx];
+		++info.gen;
+		info.node = QNodeEleInfo::NO_NODE;
+		info.slot = free_ele;
+		free_ele = eleIdx;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::updateAABBSinceInsert(const Rect& rect, const int& cnIdx) {
+		Node& cnd = nodes[cnIdx];
+		// a loose cell contains every element the node keeps, except those of root
+		if (cnd.count == 1 && looseFactor <= 0) {
+			cnd.aabbRect = rect;
+		}
+		else {
+			UnionRect(cnd.aabbRect, rect);
+		}
+		syncAABB(cnIdx);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	inline void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::syncAABB(const int& idx) {
+		if (idx == 0) return; // root has no siblings
+		childRects[(idx - 1) >> 2].Set((idx - 1) & 3, nodes[idx].aabbRect);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::compactHelper(const int& idx, const int& newIdx, QTVector<Node, Alloc>& newNodes,
+		QTVector<Eles, Alloc>& newEles, QTVector<Rect4, Alloc>& newRects) const {
+		if (nodes[idx].count != -1) return; // it's leaf
+		// the four children first, then the subtree of every child in turn
+		const int first_child = nodes[idx].first_child;
+		const int newFirst = static_cast<int>(newNodes.size());
+		newNodes[newIdx].first_child = newFirst;
+		for (int i = 0; i < 4; ++i) {
+			newNodes.push_back(nodes[first_child + i]);
+			newEles.push_back(packEles(first_child + i));
+		}
+		newRects.push_back(childRects[(first_child - 1) >> 2]);
+		for (int i = 0; i < 4; ++i)
+			compactHelper(first_child + i, newFirst + i, newNodes, newEles, newRects);
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	QNodeElesT<Payload, Coord, Alloc> BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::packEles(const int& idx) const {
+		const Eles& ne = nodeEles[idx];
+		Eles packed(alloc);
+		packed.Reserve(static_cast<int>(ne.ids.size()));
+		packed.rects.assign(ne.rects.begin(), ne.rects.end());
+		packed.payloads.assign(ne.payloads.begin(), ne.payloads.end());
+		packed.ids.assign(ne.ids.begin(), ne.ids.end());
+		return packed;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	void BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::statsHelper(const int& idx, const int& depth, QTStats& stats) const {
+		const Node& node = nodes[idx];
+		const int count = static_cast<int>(nodeEles[idx].ids.size());
+		++stats.nodeCount;
+		stats.elementCount += count;
+		if (node.count == -1) { // it's branch
+			stats.branchElementCount += count;
+			for (int i = 0; i < 4; ++i)
+				statsHelper(node.first_child + i, depth + 1, stats);
+			return;
+		}
+		++stats.leafCount;
+		stats.maxDepth = std::max(stats.maxDepth, depth);
+		stats.averageDepth += depth;
+		++stats.leafHistogram[std::min(count, leafCapacity() + 1)];
+		if (count > leafCapacity() && depth >= depthLimit()) ++stats.overfullLeafCount;
+		stats.largestLeaf = std::max(stats.largestLeaf, count);
+	}
+
+	// recursion of cleanup
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	QTRectT<Coord> BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::cleanupHelper(int idx, int& nChild) {
+		Rect retRect;
+		Node& node = nodes[idx];
+		node.dirty = false;
+		nChild = 0;
+		if (node.count != -1) { // it's leaf
+			if (node.count == 0) return retRect;
+			const Eles& ne = nodeEles[idx];
+			nChild = node.count;
+			if (looseFactor > 0) return retRect; // a loose cell needn't shrink
+			retRect = ne.GetRect(0);
+			for (int i = 1; i < node.count; ++i)
+				UnionRect(retRect, ne.GetRect(i));
+			// shrink the leaf's aabb, it may be widen by erased or moved elements
+			node.aabbRect = retRect;
+			syncAABB(idx);
+		}
+		else { // it's branch
+			// empty children's rect must not be union to the aabb
+			bool init = false;
+			bool leaves = true;
+			nChild = static_cast<int>(nodeEles[idx].ids.size()); // only a loose branch keeps elements
+			for (int i = 0; i < 4; ++i) {
+				int c;
+				const Rect rect = cleanupHelper(nodes[idx].first_child + i, c);
+				if (nodes[nodes[idx].first_child + i].count == -1) leaves = false;
+				if (c == 0) continue;
+				nChild += c;
+				if (!init) { retRect = rect; init = true; }
+				else UnionRect(retRect, rect);
+			}
+			if (looseFactor <= 0) {
+				node.aabbRect = retRect;
+				syncAABB(idx);
+			}
+			if (nChild == 0) // all children are empty
+				eraseNodes(idx);
+			// sparse leaves go back to their parent, which splits again only when it's twice as full
+			else if (leaves && nChild <= leafCapacity() / 2)
+				mergeChildren(idx);
+		}
+		return retRect;
+	}
+
+	template<typename Payload, typename Coord, int MaxDepth, int MaxElePerLeaf, typename Alloc>
+	bool BasicQuadTree<Payload, Coord, MaxDepth, MaxElePerLeaf, Alloc>::cleanupDirty(const int& idx, int& budget) {
+		if (!nodes[idx].dirty) return true;
+		if (nodes[idx].count == -1) { // it's branch
+			for (int i = 0; i < 4; ++i)
+				if (!cleanupDirty(nodes[idx].first_child + i, budget)) return false;
+		}
+		if (budget <= 0) return false;
+		--budget;
+		Node& node = nodes[idx];
+		node.dirty = false;
+		if (idx == 0 && looseFactor > 0) looseRootAABB();
+		if (node.count == -1) {
+			// children are clean now, a clean branch is never empty, so only leaves may be
+			int total = static_cast<int>(nodeEles[idx].ids.size());
+			bool leaves = true;
+			for (int i = 0; i < 4; ++i) {
+				const int count = nodes[node.first_child + i].count;
+				if (count == -1) leaves = false;
+				else total += count;
+			}
+			if (leaves && total == 0) eraseNodes(idx);
+			else {
+				if (looseFactor <= 0) unionChildren(idx);
+				// same as Cleanup, sparse leaves go back to their parent
+				if (leaves && total <= leafCapacity() / 2) mergeChildren(idx);
+			}
+		}
+		else if (node.count > 0 && looseFactor <= 0) {
+			const Eles& ne = nodeEles[idx];
+			node.aabbRect = ne.GetRect(0);
+			for (int i = 1; i < node.count; ++i)
+				UnionRect(node.aabbRect, ne.GetRect(i));
+			syncAABB(idx);
+		}
+		return true;
+	}
+
+	typedef BasicQuadTree<void*, float> QuadTree;
+	extern template class QUADTREE_API_DLL BasicQuadTree<void*, float>;
+
 }
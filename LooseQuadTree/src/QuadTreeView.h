@@ -0,0 +1,115 @@
+#pragma once
+#include "QuadTree.h"
+
+namespace LQT { // loose quad tree
+
+	// read-only tree over a snapshot written by BasicQuadTree::Save, such as a mapped file.
+	// nothing is copied or loaded, the queries read the snapshot where it is,
+	// so it must stay valid while the view is used. an element is reported by its rect and its id
+	template<typename Coord = float>
+	class BasicQuadTreeView {
+	public:
+		typedef QTRectT<Coord> Rect;
+		typedef QTPointT<Coord> Point;
+		BasicQuadTreeView();
+		// use the snapshot data ~ data + size, data must be 8 bytes aligned.
+		// return false and close the view if data isn't a snapshot of Coord or its links leave it,
+		// see IsSnapshotLinked
+		bool Open(const void* data, std::size_t size);
+		bool IsOpen() const;
+		// number of elements
+		int Size() const;
+		// onHit(const Rect&, unsigned long long id) is called for every hit, return false from it to stop.
+		// the shape is a Rect, a Point or any shape the visitor Query of BasicQuadTree takes
+		template<typename S, typename F>
+		bool Query(const S& shape, F&& onHit,
+			QueryScratch& scratch = GetThreadQueryScratch()) const;
+	private:
+		typedef QTSnapshotNodeT<Coord> Node;
+		typedef QTRect4T<Coord> Rect4;
+		// sections of the snapshot, see QTSnapshotHeader
+		const QTSnapshotHeader* header;
+		const Node* nodes;
+		const Rect4* childRects;
+		const int* eleBegin;
+		const int* blockBegin;
+		const Rect4* rects;
+		const unsigned long long* ids;
+	};
+
+	template<typename Coord>
+	BasicQuadTreeView<Coord>::BasicQuadTreeView()
+		: header(nullptr), nodes(nullptr), childRects(nullptr), eleBegin(nullptr),
+		blockBegin(nullptr), rects(nullptr), ids(nullptr) {}
+
+	template<typename Coord>
+	bool BasicQuadTreeView<Coord>::Open(const void* data, std::size_t size) {
+		header = GetSnapshotHeader<Coord>(data, size);
+		if (!header) return false;
+		const char* base = static_cast<const char*>(data);
+		nodes = reinterpret_cast<const Node*>(base + header->nodes);
+		childRects = reinterpret_cast<const Rect4*>(base + header->childRects);
+		eleBegin = reinterpret_cast<const int*>(base + header->eleBegin);
+		blockBegin = reinterpret_cast<const int*>(base + header->blockBegin);
+		rects = reinterpret_cast<const Rect4*>(base + header->rects);
+		ids = reinterpret_cast<const unsigned long long*>(base + header->ids);
+		return true;
+	}
+
+	template<typename Coord>
+	bool BasicQuadTreeView<Coord>::IsOpen() const {
+		return header != nullptr;
+	}
+
+	template<typename Coord>
+	int BasicQuadTreeView<Coord>::Size() const {
+		return header ? header->eleCount : 0;
+	}
+
+	template<typename Coord>
+	template<typename S, typename F>
+	bool BasicQuadTreeView<Coord>::Query(const S& shape, F&& onHit, QueryScratch& scratch) const {
+		// the same traversal as BasicQuadTree::query, only the part of the stack above base is ours
+		std::vector<int>& toProcess = scratch.toProcess;
+		const std::size_t base = toProcess.size();
+		bool hit = false;
+		QUADTREE_COUNT(scratch, queries, 1);
+		if (!header || !IsShapeIntersectRect(shape, nodes[0].aabbRect)) return hit;
+		toProcess.push_back(0);
+		while (toProcess.size() > base) {
+			const int idx = toProcess.back();
+			const Node& node = nodes[idx];
+			toProcess.pop_back();
+			// elements of a leaf, or of a branch in the loose mode
+			const int first = eleBegin[idx], count = eleBegin[idx + 1] - first;
+			QUADTREE_COUNT(scratch, nodesVisited, 1);
+			QUADTREE_COUNT(scratch, elementTests, count);
+			for (int blk = 0; (blk << 2) < count; ++blk) {
+				const Rect4& block = rects[blockBegin[idx] + blk];
+				int mask = GetShapeIntersectMask(shape, block);
+				if (count - (blk << 2) < 4) mask &= (1 << (count - (blk << 2))) - 1;
+				for (int i = 0; mask; ++i, mask >>= 1) {
+					if (!(mask & 1)) continue;
+					hit = true;
+					QUADTREE_COUNT(scratch, hits, 1);
+					if (!onHit(block.Get(i), ids[first + (blk << 2) + i])) {
+						toProcess.resize(base);
+						return hit;
+					}
+				}
+			}
+			if (node.count == -1) { // it's branch
+				const int mask = GetShapeIntersectMask(shape, childRects[(node.first_child - 1) >> 2]);
+				if (mask & 1) toProcess.push_back(node.first_child + 0);
+				if (mask & 2) toProcess.push_back(node.first_child + 1);
+				if (mask & 4) toProcess.push_back(node.first_child + 2);
+				if (mask & 8) toProcess.push_back(node.first_child + 3);
+			}
+		}
+		return hit;
+	}
+
+	typedef BasicQuadTreeView<float> QuadTreeView;
+	extern template class QUADTREE_API_DLL BasicQuadTreeView<float>;
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LQT { // loose quad tree
+
+	// work stealing thread pool used by the parallel operations of QuadTree.
+	// every worker owns a queue, it runs its newest task first and steals the oldest task of others
+	class QTThreadPool {
+	public:
+		// counts the unfinished tasks started with it
+		class TaskGroup {
+			friend class QTThreadPool;
+			std::atomic<int> pending;
+		public:
+			TaskGroup() : pending(0) {}
+		};
+		// threadCount = 0 means one worker per hardware thread
+		explicit QTThreadPool(unsigned int threadCount = 0) : queued(0), stop(false) {
+			if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+			if (threadCount == 0) threadCount = 1;
+			// the last queue is shared by the threads which are not workers
+			for (unsigned int i = 0; i <= threadCount; ++i)
+				queues.emplace_back(new Queue());
+			for (unsigned int i = 0; i < threadCount; ++i)
+				workers.emplace_back([this, i]() { workerLoop(i); });
+		}
+		~QTThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stop = true;
+			}
+			sleepCv.notify_all();
+			for (std::thread& worker : workers) worker.join();
+		}
+		QTThreadPool(const QTThreadPool&) = delete;
+		QTThreadPool& operator=(const QTThreadPool&) = delete;
+		unsigned int Size() const {
+			return static_cast<unsigned int>(workers.size());
+		}
+		// run the task on the pool, a task may start more tasks
+		void Run(TaskGroup& group, std::function<void()> task) {
+			group.pending.fetch_add(1);
+			Queue& queue = *queues[currentQueue()];
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.tasks.push_back({ std::move(task), &group });
+			}
+			queued.fetch_add(1);
+			// take the lock so a worker can't miss the notify between its check and its wait
+			{ std::lock_guard<std::mutex> lock(sleepMutex); }
+			sleepCv.notify_one();
+		}
+		// wait until every task of the group is finished, the caller runs tasks meanwhile
+		void Wait(TaskGroup& group) {
+			const int self = currentQueue();
+			Task task;
+			while (group.pending.load() > 0) {
+				if (popTask(self, task)) runTask(task);
+				else std::this_thread::yield();
+			}
+		}
+	private:
+		struct Task {
+			std::function<void()> func;
+			TaskGroup* group;
+		};
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+		// index of the queue owned by the calling thread
+		int currentQueue() const {
+			return currentPool() == this ? currentWorker() : static_cast<int>(workers.size());
+		}
+		static const QTThreadPool*& currentPool() {
+			static thread_local const QTThreadPool* pool = nullptr;
+			return pool;
+		}
+		static int& currentWorker() {
+			static thread_local int worker = -1;
+			return worker;
+		}
+		// newest task of its own queue, or the oldest task of another queue
+		bool popTask(const int& self, Task& task) {
+			const int n = static_cast<int>(queues.size());
+			for (int i = 0; i < n; ++i) {
+				Queue& queue = *queues[(self + i) % n];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (queue.tasks.empty()) continue;
+				if (i == 0) {
+					task = std::move(queue.tasks.back());
+					queue.tasks.pop_back();
+				}
+				else {
+					task = std::move(queue.tasks.front());
+					queue.tasks.pop_front();
+				}
+				queued.fetch_sub(1);
+				return true;
+			}
+			return false;
+		}
+		void runTask(Task& task) {
+			task.func();
+			task.func = nullptr;
+			task.group->pending.fetch_sub(1);
+		}
+		void workerLoop(const unsigned int& index) {
+			currentPool() = this;
+			currentWorker() = static_cast<int>(index);
+			Task task;
+			while (true) {
+				if (popTask(static_cast<int>(index), task)) {
+					runTask(task);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleepCv.wait(lock, [this]() { return stop || queued.load() > 0; });
+				if (stop) return;
+			}
+		}
+	private:
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+		// number of tasks in all queues
+		std::atomic<int> queued;
+		bool stop;
+		std::mutex sleepMutex;
+		std::condition_variable sleepCv;
+	};
+
+}